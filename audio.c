@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Sound. Every machine plays a 128 bit, 1 bit per sample pattern while its sound timer runs:
+// XO-CHIP programs load their own (F002) and pick the rate (FX3A), the others keep the
+// default square wave. At the end of each frame the machine pushes what it played into a
+// single producer, single consumer ring (push_audio); the output renders samples from it
+// (render_audio) on its own thread, the SDL audio callback, or on the emulation thread
+// through a sink (drain_audio). The ring is the only thing the two sides share: a full ring
+// drops the frame, an empty one holds the last frame once and then goes quiet, and an output
+// that falls behind skips ahead, so neither side waits, locks or allocates.
+
+// Pattern bits per second at pitch 64, every 48 pitch steps double it
+#define PATTERN_RATE 4000.0
+#define PITCH_STEP 1.0145453349375237 // 2^(1/48)
+
+// Phase increment per sample for a pattern rate; 32 bits hold 128 pattern bits in 7.25 fixed point
+static uint32_t phase_step(double bits_per_second, uint32_t rate)
+{
+    return (uint32_t)(bits_per_second / rate * (1u << 25));
+}
+
+void init_audio(audio_t *audio, uint32_t rate)
+{
+    memset(audio, 0, sizeof *audio);
+    atomic_init(&audio->head, 0);
+    atomic_init(&audio->tail, 0);
+    audio->rate = rate;
+    audio->frame_samples = rate / FRAME_RATE;
+
+    double bits = PATTERN_RATE;
+    for (int pitch = AUDIO_PITCH; pitch < 256; pitch++, bits *= PITCH_STEP)
+        audio->steps[pitch] = phase_step(bits, rate);
+    bits = PATTERN_RATE;
+    for (int pitch = AUDIO_PITCH - 1; pitch >= 0; pitch--)
+    {
+        bits /= PITCH_STEP;
+        audio->steps[pitch] = phase_step(bits, rate);
+    }
+}
+
+// Producer, the emulation thread: what the frame that just ran played. Never waits, a frame
+// that finds the ring full is dropped
+void push_audio(audio_t *audio, const chip8_t *chip8)
+{
+    const uint32_t head = atomic_load_explicit(&audio->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_acquire);
+    if (head - tail == AUDIO_RING)
+    {
+        audio->dropped++;
+        return;
+    }
+    audio_frame_t *frame = &audio->frames[head % AUDIO_RING];
+    frame->on = chip8->sound_timer > 0;
+    frame->pitch = chip8->pitch;
+    memcpy(frame->pattern, chip8->pattern, AUDIO_PATTERN);
+    atomic_store_explicit(&audio->head, head + 1, memory_order_release);
+}
+
+// Consumer: start playing the next frame
+static void next_frame(audio_t *audio)
+{
+    uint32_t tail = atomic_load_explicit(&audio->tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&audio->head, memory_order_acquire);
+    audio->left = audio->frame_samples;
+    if (head == tail)
+    {
+        // Nothing new: keep the tone up for one frame of jitter, then stop (paused machine)
+        audio->underruns++;
+        audio->current.on = audio->current.on && audio->held == 0;
+        audio->held++;
+        return;
+    }
+    if (head - tail > AUDIO_MAX_LAG)
+    {
+        audio->skipped += head - tail - 1;
+        tail = head - 1;
+    }
+    audio->current = audio->frames[tail % AUDIO_RING];
+    audio->held = 0;
+    atomic_store_explicit(&audio->tail, tail + 1, memory_order_release);
+}
+
+// Consumer, the output thread: the next samples, 16 bit mono
+void render_audio(audio_t *audio, int16_t *out, size_t samples)
+{
+    for (size_t i = 0; i < samples; i++)
+    {
+        if (!audio->left)
+            next_frame(audio);
+        audio->left--;
+        if (!audio->current.on)
+        {
+            out[i] = 0;
+            continue;
+        }
+        const uint32_t bit = audio->phase >> 25;
+        out[i] = (audio->current.pattern[bit / 8] >> (7 - bit % 8)) & 1 ? AUDIO_VOLUME : -AUDIO_VOLUME;
+        audio->phase += audio->steps[audio->current.pitch];
+    }
+}
+
+static void put_le(FILE *file, uint64_t value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+// RIFF header of a 16 bit mono PCM WAV file holding the given number of samples
+static void put_wav_header(FILE *file, uint32_t rate, uint64_t samples)
+{
+    const uint32_t data = samples * 2;
+    fwrite("RIFF", 4, 1, file);
+    put_le(file, 36 + data, 4);
+    fwrite("WAVEfmt ", 8, 1, file);
+    put_le(file, 16, 4);       // fmt chunk size
+    put_le(file, 1, 2);        // PCM
+    put_le(file, 1, 2);        // Mono
+    put_le(file, rate, 4);
+    put_le(file, rate * 2, 4); // Bytes per second
+    put_le(file, 2, 2);        // Bytes per sample
+    put_le(file, 16, 2);       // Bits per sample
+    fwrite("data", 4, 1, file);
+    put_le(file, data, 4);
+}
+
+// Headless output on the emulation thread: path is a WAV file to write, or "null"
+bool open_audio_sink(audio_sink_t *sink, const audio_t *audio, const char *path)
+{
+    memset(sink, 0, sizeof *sink);
+    sink->buffer = malloc(audio->frame_samples * sizeof *sink->buffer);
+    if (!sink->buffer)
+    {
+        printf("Could not allocate the audio buffer\n");
+        return false;
+    }
+    sink->rate = audio->rate;
+    if (!strcmp(path, "null"))
+        return true;
+
+    sink->file = fopen(path, "wb");
+    if (!sink->file)
+    {
+        printf("Could not create WAV file %s\n", path);
+        free(sink->buffer);
+        return false;
+    }
+    put_wav_header(sink->file, audio->rate, 0); // Sizes are filled in on close
+    return true;
+}
+
+// Render every frame the machine has pushed, one frame of samples at a time
+void drain_audio(audio_t *audio, audio_sink_t *sink)
+{
+    while (atomic_load_explicit(&audio->head, memory_order_acquire) !=
+           atomic_load_explicit(&audio->tail, memory_order_relaxed))
+    {
+        render_audio(audio, sink->buffer, audio->frame_samples);
+        sink->samples += audio->frame_samples;
+        for (uint32_t i = 0; sink->file && i < audio->frame_samples; i++)
+            put_le(sink->file, (uint16_t)sink->buffer[i], 2);
+    }
+}
+
+void close_audio_sink(audio_sink_t *sink)
+{
+    if (sink->file)
+    {
+        rewind(sink->file);
+        put_wav_header(sink->file, sink->rate, sink->samples);
+        if (ferror(sink->file))
+            printf("Could not write the WAV file\n");
+        fclose(sink->file);
+    }
+    free(sink->buffer);
+    memset(sink, 0, sizeof *sink);
+}
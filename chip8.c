@@ -2,13 +2,22 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #include "SDL.h"
 #include "chip8.h"
 
+typedef struct
+{
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture; // HIRES_WIDTH x HIRES_HEIGHT RGBA, the current resolution's corner is scaled to the window
+    SDL_AudioDeviceID audio_device; // 0 = no sound
+} sdl_t;
+
 // Initializare
-bool init_sdl(sdl_t *sdl, config_t config)
+bool init_sdl(sdl_t *sdl, const config_t *config)
 {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0)
     {
@@ -18,8 +27,8 @@ bool init_sdl(sdl_t *sdl, config_t config)
     sdl->window = SDL_CreateWindow("CHIP8 Emulator",
                                    SDL_WINDOWPOS_CENTERED,
                                    SDL_WINDOWPOS_CENTERED,
-                                   config.window_width * config.scale_factor,
-                                   config.window_height * config.scale_factor,
+                                   config->window_width * config->scale_factor,
+                                   config->window_height * config->scale_factor,
                                    0);
 
     if (!sdl->window)
@@ -28,87 +37,151 @@ bool init_sdl(sdl_t *sdl, config_t config)
         return false;
     }
     // RENDERER
-    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_ACCELERATED);
+    uint32_t renderer_flags = SDL_RENDERER_ACCELERATED;
+    if (config->vsync)
+        renderer_flags |= SDL_RENDERER_PRESENTVSYNC; // Present waits for the display refresh
+    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, renderer_flags);
     if (!sdl->renderer)
     {
         printf("renderer could not be created! %s\n", SDL_GetError());
         return false;
     }
+    // Framebuffer texture, one texel per pixel, big enough for hires. Nearest scaling keeps pixels sharp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                     HIRES_WIDTH, HIRES_HEIGHT);
+    if (!sdl->texture)
+    {
+        printf("texture could not be created! %s\n", SDL_GetError());
+        return false;
+    }
     return true;
 }
 
-// Iniitial emulator config from passed arguments
-bool set_config_from_args(config_t *config, int argc, char **argv)
+// SDL's audio thread: the consumer side of the machine's sound ring
+static void audio_callback(void *userdata, Uint8 *stream, int len)
 {
+    render_audio(userdata, (int16_t *)stream, len / sizeof(int16_t));
+}
 
-    // set default
-    config->window_width = 64;  // CHIP8 X RESOLUTION
-    config->window_height = 32; // Y
-    config->fg_color = 0xFFFFFFFF;
-    config->bg_color = 0x000000FF;
-    config->scale_factor = 20;             // 1280x640
-    config->instructions_per_second = 600; // standard speed
-    config->current_extension = 0;         // CHIP8
-    // override default from args
-    for (int i = 1; i < argc; i++)
+// Open the audio device and start playing from the ring. Without a device the emulator runs silent
+bool open_audio(sdl_t *sdl, audio_t *audio)
+{
+    init_audio(audio, AUDIO_RATE);
+    SDL_AudioSpec want = {
+        .freq = AUDIO_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = 512,
+        .callback = audio_callback,
+        .userdata = audio,
+    };
+    sdl->audio_device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (!sdl->audio_device)
     {
-        (void)argv[i];
+        printf("No sound, audio device could not be opened: %s\n", SDL_GetError());
+        return false;
     }
-
+    SDL_PauseAudioDevice(sdl->audio_device, 0);
     return true;
 }
 
 // clear sdl window to background color
-void clear_screen(sdl_t sdl, const config_t config)
+void clear_screen(const sdl_t *sdl, const config_t *config)
 {
-    uint8_t r = (config.bg_color >> 24) & 0xFF;
-    uint8_t g = (config.bg_color >> 16) & 0xFF;
-    uint8_t b = (config.bg_color >> 8) & 0xFF;
-    uint8_t a = (config.bg_color >> 0) & 0xFF;
+    uint8_t r = (config->bg_color >> 24) & 0xFF;
+    uint8_t g = (config->bg_color >> 16) & 0xFF;
+    uint8_t b = (config->bg_color >> 8) & 0xFF;
+    uint8_t a = (config->bg_color >> 0) & 0xFF;
 
-    SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-    SDL_RenderClear(sdl.renderer);
+    SDL_SetRenderDrawColor(sdl->renderer, r, g, b, a);
+    SDL_RenderClear(sdl->renderer);
 }
 
-// update window with any changes
-void update_screen(sdl_t sdl, config_t config, chip8_t chip8)
+// update window with any changes: expand the dirty display rows into texels, upload each
+// run of consecutive dirty rows into the streaming texture and let the GPU scale it to the window
+void update_screen(const sdl_t *sdl, const config_t *config, framebuffer_t fb)
 {
-    SDL_Rect rect = {.x = 0,
-                     .y = 0,
-                     .w = config.scale_factor,
-                     .h = config.scale_factor};
-    // Get color
-    uint8_t fg_r = (config.fg_color >> 24) & 0xFF;
-    uint8_t fg_g = (config.fg_color >> 16) & 0xFF;
-    uint8_t fg_b = (config.fg_color >> 8) & 0xFF;
-    uint8_t fg_a = (config.fg_color >> 0) & 0xFF;
-
-    uint8_t bg_r = (config.bg_color >> 24) & 0xFF;
-    uint8_t bg_g = (config.bg_color >> 16) & 0xFF;
-    uint8_t bg_b = (config.bg_color >> 8) & 0xFF;
-    uint8_t bg_a = (config.bg_color >> 0) & 0xFF;
-
-    // Unidimensional index = y * window_width + x
-    for (uint32_t i = 0; i < sizeof chip8.display; i++)
+    // RGBA8888 texels have the same 0xRRGGBBAA layout as the configured colors. A pixel's
+    // color is indexed by its bits in every plane, plane 0 the low bit
+    const uint32_t colors[4] = {(uint32_t)config->bg_color, (uint32_t)config->fg_color,
+                                (uint32_t)config->fg2_color, (uint32_t)config->blend_color};
+    static uint32_t texels[HIRES_HEIGHT][HIRES_WIDTH]; // 32 KB, off the stack
+    uint64_t dirty = fb.dirty_rows;
+
+    while (dirty)
     {
-        // 1D i value => 2D X/Y
-        // X = i % window_width
-        // Y = i / window_width
-        rect.x = (i % config.window_width) * config.scale_factor;
-        rect.y = (i / config.window_width) * config.scale_factor;
-        if (chip8.display[i]) // fg color
+        // Next run of consecutive dirty rows [first, last)
+        const uint32_t first = __builtin_ctzll(dirty);
+        uint32_t last = first;
+        while (last < fb.height && (dirty >> last) & 1)
+            last++;
+        dirty &= ~0ULL << last;
+
+        for (uint32_t y = first; y < last; y++)
         {
-            SDL_SetRenderDrawColor(sdl.renderer, fg_r, fg_g, fg_b, fg_a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
+            for (uint32_t x = 0; x < fb.width; x++)
+            {
+                uint32_t color = 0;
+                for (uint32_t p = 0; p < fb.planes; p++)
+                    color |= ((fb.rows[p][x / 64][y] >> (63 - x % 64)) & 1) << p;
+                texels[y][x] = colors[color];
+            }
         }
 
-        else
-        { // background color
-            SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
-        }
+        const SDL_Rect rows = {.x = 0, .y = first, .w = fb.width, .h = last - first};
+        SDL_UpdateTexture(sdl->texture, &rows, texels[first], sizeof texels[0]);
     }
-    SDL_RenderPresent(sdl.renderer);
+
+    const SDL_Rect screen = {.x = 0, .y = 0, .w = fb.width, .h = fb.height};
+    SDL_RenderCopy(sdl->renderer, sdl->texture, &screen, NULL);
+    SDL_RenderPresent(sdl->renderer);
+}
+
+// Quick save slot next to the ROM, <rom_name>.state: F5 saves, F9 loads
+void quick_save(const chip8_t *chip8)
+{
+    char path[4096];
+    static uint8_t state[SAVESTATE_MAX_SIZE];
+    const size_t size = save_state(chip8, NULL, state, sizeof state);
+    snprintf(path, sizeof path, "%s.state", chip8->rom_name);
+    FILE *out = fopen(path, "wb");
+    if (!out || fwrite(state, size, 1, out) != 1)
+        printf("Could not write save state %s\n", path);
+    else
+        printf("Saved state to %s\n", path);
+    if (out)
+        fclose(out);
+}
+
+void quick_load(chip8_t *chip8)
+{
+    char path[4096];
+    static uint8_t state[SAVESTATE_MAX_SIZE];
+    static snapshot_t snap; // Not a chain: only complete states load
+    snap.valid = false;
+    snprintf(path, sizeof path, "%s.state", chip8->rom_name);
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        printf("No save state %s\n", path);
+        return;
+    }
+    const size_t size = fread(state, 1, sizeof state, in);
+    fclose(in);
+    if (load_state(chip8, &snap, state, size))
+        printf("Loaded state from %s\n", path);
+}
+
+// With --trace, the last instructions go to <rom_name>.trace on F10 and on exit
+void quick_trace(const chip8_t *chip8)
+{
+    char path[4096];
+    if (!chip8->trace)
+        return;
+    snprintf(path, sizeof path, "%s.trace", chip8->rom_name);
+    if (dump_trace(chip8->trace, path))
+        printf("Dumped the last instructions to %s\n", path);
 }
 
 // CHIP8 keypad to querty
@@ -118,7 +191,31 @@ void update_screen(sdl_t sdl, config_t config, chip8_t chip8)
 7 8 9 E    A S D F
 A 0 B F    Z X C V
 */
-void handle_input(chip8_t *chip8)
+// With a debugger attached (--debug, --break, ...) Space stops and continues, F6 steps one
+// instruction and F7 runs to the next frame. Every stop prints the machine
+static void debug_keys(chip8_t *chip8, const config_t *config, SDL_Keycode key)
+{
+    switch (key)
+    {
+    case SDLK_SPACE:
+        if (chip8->debug->stopped)
+            debug_continue(chip8, config);
+        else
+            debug_break(chip8);
+        break;
+    case SDLK_F6: debug_step(chip8, config); break;
+    case SDLK_F7:
+        run_to_frame(chip8, chip8->frame + 1);
+        debug_continue(chip8, config);
+        break;
+    default: return;
+    }
+    if (chip8->debug->stopped)
+        print_debug_stop(chip8, stdout);
+}
+
+// While recording an input log, jumps in machine state (F9, rewind) are ignored so the log replays
+void handle_input(chip8_t *chip8, const config_t *config, bool *rewinding, bool recording)
 {
     SDL_Event event;
     while (SDL_PollEvent(&event))
@@ -136,6 +233,14 @@ void handle_input(chip8_t *chip8)
                         break;
                         
                     case SDLK_SPACE:
+                    case SDLK_F6:
+                    case SDLK_F7:
+                        if (chip8->debug) {
+                            debug_keys(chip8, config, event.key.keysym.sym);
+                            break;
+                        }
+                        if (event.key.keysym.sym != SDLK_SPACE)
+                            break;
                         // Space bar
                         if (chip8->state == RUNNING) {
                             chip8->state = PAUSED;  // Pause
@@ -145,6 +250,11 @@ void handle_input(chip8_t *chip8)
                         }
                         break;
 
+                    case SDLK_F5: quick_save(chip8); break;
+                    case SDLK_F9: if (!recording) quick_load(chip8); break;
+                    case SDLK_BACKSPACE: *rewinding = !recording; break; // Held: run backwards
+                    case SDLK_F10: quick_trace(chip8); break;
+
                     // Map qwerty keys to CHIP8 keypad
                     case SDLK_1: chip8->keypad[0x1] = true; break;
                     case SDLK_2: chip8->keypad[0x2] = true; break;
@@ -173,6 +283,8 @@ void handle_input(chip8_t *chip8)
 
        case SDL_KEYUP:
                 switch (event.key.keysym.sym) {
+                    case SDLK_BACKSPACE: *rewinding = false; break;
+
                     // Map qwerty keys to CHIP8 keypad
                     case SDLK_1: chip8->keypad[0x1] = false; break;
                     case SDLK_2: chip8->keypad[0x2] = false; break;
@@ -202,619 +314,46 @@ void handle_input(chip8_t *chip8)
     }
 }
 
-bool init_chip8(chip8_t *chip8, char rom_name[])
+// High resolution monotonic clock in nanoseconds
+uint64_t clock_ns(void)
 {
-    const uint32_t entry_point = 0x200; // Where programs start
-    const uint8_t font[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-    // Load font
-    memcpy(&chip8->ram[0], font, sizeof(font)); // FONT STARTS AT 0x0
-    // Load ROM
-    FILE *rom = fopen(rom_name, "rb");
-    if (!rom)
-    {
-        printf("Could not open ROM FILE: %s\n", rom_name);
-        return false;
-    }
-
-    // Get ROM SIZE
-    fseek(rom, 0, SEEK_END);
-    const size_t rom_size = ftell(rom); // Moment C
-    const size_t max_size = sizeof chip8->ram - entry_point;
-    rewind(rom);
-
-    if (rom_size > max_size)
-    {
-        printf("Rom file %s is bigger than RAM !?. Max size: %zu, Rom size: %zu", rom_name, max_size, rom_size);
-        return false;
-    }
-
-    if (fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1)
-    {
-        printf("Could not read rom file into CHIP8 RAM\n");
-        return false;
-    };
-    fclose(rom);
-    // Set chip8 machine defaults
-    chip8->state = RUNNING;  // Default state machine
-    chip8->PC = entry_point; // Where programs start being loaded in RAM
-    chip8->rom_name = rom_name;
-    chip8->stack_ptr = &chip8->stack[0];
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    // Split to avoid overflowing counter * 1e9
+    return counter / freq * 1000000000ULL + counter % freq * 1000000000ULL / freq;
+}
 
-    return true;
+// Sleep until the given clock time: SDL_Delay for the coarse part, leaving a millisecond
+// of slack for scheduler wakeup jitter, then yield-spin the remainder
+void wait_until(uint64_t deadline_ns)
+{
+    uint64_t now = clock_ns();
+    if (deadline_ns > now + 2000000)
+        SDL_Delay((deadline_ns - now) / 1000000 - 1);
+    while (clock_ns() < deadline_ns)
+        SDL_Delay(0);
 }
 
 // Cleanup
-void final_cleanup(sdl_t sdl)
+void final_cleanup(const sdl_t *sdl)
 {
-    SDL_DestroyRenderer(sdl.renderer);
-    SDL_DestroyWindow(sdl.window);
+    if (sdl->audio_device)
+        SDL_CloseAudioDevice(sdl->audio_device);
+    SDL_DestroyTexture(sdl->texture);
+    SDL_DestroyRenderer(sdl->renderer);
+    SDL_DestroyWindow(sdl->window);
     SDL_Quit();
     return;
 }
 
-#ifdef DEBUG
-
-void print_debug_info(chip8_t *chip8)
-{
-    printf("Adress: 0x%04X, Opcode: 0x%04X Desc: ", chip8->PC - 2, chip8->inst.opcode);
-    switch ((chip8->inst.opcode >> 12) & 0x0F) // First 4 bits of the opcode
-    {
-
-    case 0x0:                             // The instruction begins with 0
-        if (chip8->inst.opcode == 0x00E0) // Clear screen
-        {
-            printf("Clear screen\n");
-        }
-        else if (chip8->inst.opcode == 0x00EE) // Return
-        {
-            printf("Return from subroutine to adress 0x%04X\n", *(chip8->stack_ptr - 1));
-        }
-        break;
-    case 0x01:
-        // goto NNN
-        printf("Jump to adress %04X\n", chip8->inst.NNN);
-        // chip8->PC = chip8->inst.NNN;
-        break;
-    case 0x02: // Calls subroutine at NNN
-        printf("Calls subroutine at NNN(0x%04X)", chip8->inst.NNN);
-        break;
-    case 0x03:
-        // 3XNN -> skips the next instruction if VX = NN
-        printf("If V%X == NN (0x%02X == 0x%02X), skip next instruction\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-        break;
-    case 0x04:
-        // 4XNN -> if(Vx != NN) skip the next instruiction
-        printf("If V%X != NN (0x%02X == 0x%02X), skip next instruction\n", chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.NN);
-        break;
-
-    case 0x05:
-        // 5XNN -> if VX == VY skip the next insturction
-        printf("If V%X == V%X (0x%02X == 0x%02X), skip next instruction\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X], chip8->V[chip8->inst.Y]);
-        break;
-    case 0x06:
-        // 0x6XNN; V[X] <= NN
-        printf("Set register V%X to NN(0x%02X)\n", chip8->inst.X, chip8->inst.NN);
-        break;
-    case 0x07:
-        // 0x6XNN; V[X] <= NN
-        printf("Set register V%X to V%X + NN(0x%02X), result: %02X\n", chip8->inst.X, chip8->inst.X, chip8->inst.NN, chip8->V[chip8->inst.X] + chip8->inst.NN);
-        break;
-    case 0x08: // Operatii aritmetice
-        uint8_t X = chip8->inst.X;
-        uint8_t Y = chip8->inst.Y;
-        uint8_t carry = 0;
-        switch (chip8->inst.N)
-        {
-        case 0:
-            printf("V%X = V%X (V%X = 0x%02X )\n", X, Y, X, chip8->V[Y]);
-            break;
-
-        case 1:
-            printf("V%X |= V%X (V%X = 0x%02X )\n", X, Y, X, chip8->V[X] | chip8->V[Y]);
-            break;
-
-        case 2:
-            printf("V%X &= V%X (V%X = 0x%02X )\n", X, Y, X, chip8->V[X] & chip8->V[Y]);
-            break;
-
-        case 3:
-            printf("V%X ^= V%X (V%X = 0x%02X )\n", X, Y, X, chip8->V[X] ^ chip8->V[Y]);
-            break;
-
-        case 4:
-            uint16_t overflow_check = (uint16_t)(chip8->V[X] + chip8->V[Y]);
-            if (overflow_check > 255)
-                carry = 1;
-            else
-                carry = 0;
-            printf("V%X += V%X (V%X = 0x%02X ), VF = %01X \n", X, Y, X, chip8->V[X] + chip8->V[Y], carry);
-            break;
-
-        case 5:
-            // chip8->V[X] = chip8->V[X] - chip8->V[Y];
-            if (chip8->V[X] >= chip8->V[Y])
-                carry = 1;
-            else
-                carry = 0;
-            printf("V%X -= V%X (V%X = 0x%02X, V%X = 0x%02X), result = 0x%02X, VF = %01X \n", X, Y, X, chip8->V[X], Y, chip8->V[Y], chip8->V[X] - chip8->V[Y], carry);
-            break;
-
-        case 6:
-            carry = chip8->V[X] & 1;
-            printf("V%X >>= 1 (V%X = 0x%02X ), VF = %01X \n", X, X, chip8->V[X] >> 1, carry);
-            break;
-
-        case 7:
-            // chip8->V[X] = chip8->V[Y] - chip8->V[X];
-            if (chip8->V[Y] >= chip8->V[X])
-                carry = 1;
-            else
-                carry = 0;
-            printf("V%X = V%X - V%X (V%X = 0x%02X ), VF = %01X \n", X, Y, X, X, chip8->V[Y] - chip8->V[X], carry);
-            break;
-
-        case 0x0E:
-            carry = (chip8->V[X] & (1 << 7));
-            printf("V%X << = 1 (V%X = 0x%02X ), VF = %01X \n", X, X, chip8->V[X] << 1, carry);
-            // chip8->V[X] <<=1;
-            // chip8->V[0x0F] = carry;
-            break;
-        }
-        break;
-
-    case 0x0E:                      // input handling
-        if (chip8->inst.NN == 0x9E) // if(key() == VX) skip the next instruction
-        {
-            printf("If key at V%X(0x%02X) is pressed, skip the next instruction\n", chip8->inst.X, chip8->V[chip8->inst.X]);
-            break;
-        }
-        else if (chip8->inst.NN == 0xA1)
-        {
-            printf("If key at V%X(0x%02X) is not pressed, skip the next instruction\n", chip8->inst.X, chip8->V[chip8->inst.X]);
-            break;
-        }
-        break;
-
-        break;
-    case 0x09:
-        printf("If V%X != V%X (0x%02X == 0x%02X), skip next instruction\n", chip8->inst.X, chip8->inst.Y, chip8->V[chip8->inst.X], chip8->V[chip8->inst.Y]);
-        break;
-    case 0x0A:
-        // 0xANNN; I (index register) <= NNN
-        printf("Index register 0x%04X <- 0x%04X\n", chip8->I, chip8->inst.NNN);
-        break;
-    case 0x0B:
-        // 0xBNNN: jump to adress NNN + V[0]
-        printf("Jump to adress NNN + V[0] (0x%04X)\n", chip8->inst.NNN + chip8->V[0]);
-        break;
-    case 0x0C:
-        printf("Set V%X = rand() %% 256 & %02X (NN)", chip8->inst.X, chip8->inst.NN);
-        break;
-    case 0x0D:
-        // 0xDXYN: draw N height sprite at coords V[X], V[Y]
-        // Read from memory location I.
-        // VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen
-        printf("Draw  N(%u) height sprite at coords V%X(0x%02X), V%X(0x%02X) from I (0x%04X). VF = 1/0\n",
-               chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, chip8->V[chip8->inst.Y], chip8->I);
-        break;
-    case 0x0F:
-        switch (chip8->inst.NN)
-        {
-        case 0x0A:
-            // 0x0FX0A : VX = get_key(); wait until a keypress then store it in VX
-            printf("V%X = get_key(); wait until a keypress and store it in V%X\n", chip8->inst.X, chip8->inst.X);
-            break;
-        case 0x1E:
-            // 0xFX1E: I += VX
-            printf("I(%04X) += V%X: I = %04X\n", chip8->I, chip8->inst.X, chip8->I + chip8->V[chip8->inst.X]);
-            break;
-        case 0x07:
-            // 0xFX07: VX = delay timer
-            printf("V%X = %02X (delay timer)\n", chip8->inst.X, chip8->delay_timer);
-            break;
-        case 0x15:
-            // 0xFX1: delay_timer = VX
-            printf("%02X (delay timer) = V%X(%02X)\n", chip8->delay_timer, chip8->inst.X, chip8->V[chip8->inst.X]);
-            break;
-        case 0x18:
-            // 0xF18 sound timer = VX
-            printf("%02X (sound timer) = V%X(%02X)\n", chip8->sound_timer, chip8->inst.X, chip8->V[chip8->inst.X]);
-            break;
-
-        case 0x29:
-            // 0xFX29 // i = sprite_adr[VX];
-            printf("Set I to sprite location at V%X(0x%02X - 0-F)\n", chip8->inst.X, chip8->V[chip8->inst.X]);
-            break;
-        case 0x33:
-            // stores the BCD representaiton of VX, I = hundrend's digit, I+1 = ten's digit, i+2 = one's digit
-            printf("Stored BCD representation of VX at I for drawing i suppose\n");
-            break;
-        case 0x55:
-            // 0xFX55: registry dump from 0 to VX at I
-            printf("Register dump V0 - V%X at memory from I(0x%04X)\n", chip8->inst.X, chip8->I);
-            break;
-        case 0x65:
-            // 0xF65: registry load V0 - VX from I
-            printf("Register load V0 - V%X from memory I(0x%04X)\n", chip8->inst.X, chip8->I);
-            break;
-        default:
-            printf("Unimplemented or invalid opcode\n");
-            break;
-        }
-
-        break;
-    default:
-        printf("Unimplemented or invalid opcode\n");
-        break;
-    }
-}
-#endif
-
-void emulate_instruction(chip8_t *chip8, config_t config)
-{
-    // Get next opcode from RAM
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | (chip8->ram[chip8->PC + 1]); // little endian -> big endian
-    chip8->PC += 2;
-    chip8->inst.NNN = chip8->inst.opcode & 0x0FFF;
-    chip8->inst.NN = chip8->inst.opcode & 0x00FF;
-    chip8->inst.N = chip8->inst.opcode & 0x000F;
-    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
-
-#ifdef DEBUG
-    print_debug_info(chip8);
-#endif
-
-    // Emulate opcode
-    switch ((chip8->inst.opcode >> 12) & 0x0F) // First 4 bits of the opcode
-    {
-    case 0x00:
-        if (chip8->inst.opcode == 0x00E0) // Clear screen
-        {
-            memset(&chip8->display[0], 0, 64 * 32);
-            chip8->draw = true;
-        }
-        else if (chip8->inst.opcode == 0x00EE) // Return from subroutine
-        {
-            // Returns from a subroutine
-            chip8->PC = *(--chip8->stack_ptr);
-        }
-        else
-        {
-            // printf("Unimplemeneted\n");
-            int ttttt = 0;
-            if (ttttt == 5)
-                ttttt = 2;
-        }
-        break;
-
-    case 0x01:
-        // goto NNN
-        chip8->PC = chip8->inst.NNN;
-        break;
-    case 0x02:                           // Calls subroutine at NNN
-        *chip8->stack_ptr++ = chip8->PC; // Push return adress
-        chip8->PC = chip8->inst.NNN;     // Change program counter
-        break;
-    case 0x03:
-        // 3XNN -> skips the next instruction if VX = NN
-        if (chip8->V[chip8->inst.X] == chip8->inst.NN)
-            chip8->PC += 2;
-        break;
-
-    case 0x04:
-        // 4XNN -> if(Vx != NN) skip the next instruiction
-        if (chip8->V[chip8->inst.X] != chip8->inst.NN)
-            chip8->PC += 2;
-        break;
-
-    case 0x05:
-        // 5XNN -> if VX == VY skip the next insturction
-        if (chip8->inst.N != 0)
-            break;
-
-        if (chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y])
-            chip8->PC += 2;
-        break;
-
-    case 0x06:
-        // 0x6XNN; V[X] <= NN
-        chip8->V[chip8->inst.X] = chip8->inst.NN;
-        break;
-
-    case 0x07:
-        // 0x7XNN. V[X] += NN
-        chip8->V[chip8->inst.X] += chip8->inst.NN;
-        break;
-
-    case 0x08: // Operatii aritmetice
-        uint8_t X = chip8->inst.X;
-        uint8_t Y = chip8->inst.Y;
-        uint16_t carry = 0;
-        switch (chip8->inst.N)
-        {
-        case 0:
-            chip8->V[X] = chip8->V[Y];
-            break;
-
-        case 1:
-            chip8->V[X] |= chip8->V[Y];
-            if (config.current_extension == 0)
-                chip8->V[0xF] = 0;
-            break;
-
-        case 2:
-            chip8->V[X] &= chip8->V[Y];
-            if (config.current_extension == 0)
-                chip8->V[0xF] = 0;
-            break;
-
-        case 3:
-            chip8->V[X] ^= chip8->V[Y];
-            if (config.current_extension == 0)
-                chip8->V[0xF] = 0;
-            break;
-
-        case 4:
-            chip8->V[X] = chip8->V[X] + chip8->V[Y];
-            carry = ((uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255);
-            chip8->V[X] += chip8->V[Y];
-            chip8->V[0xF] = carry;
-            break;
-
-        case 5:
-            if (chip8->V[X] >= chip8->V[Y])
-                chip8->V[0xF] = 1;
-            else
-                chip8->V[0xF] = 0;
-            chip8->V[X] = chip8->V[X] - chip8->V[Y];
-            break;
-        case 6:
-            if (config.current_extension == 0)
-            {
-                carry = chip8->V[chip8->inst.Y] & 1;                    // Use VY
-                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1; // Set VX = VY result
-            }
-            else
-            {
-                carry = chip8->V[chip8->inst.X] & 1; // Use VX
-                chip8->V[chip8->inst.X] >>= 1;       // Use VX
-            }
-
-            chip8->V[0xF] = carry;
-            break;
-        case 7:
-            chip8->V[X] = chip8->V[Y] - chip8->V[X];
-            carry = (chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]);
-            chip8->V[0xF] = carry;
-            break;
-
-        case 0x0E:
-            if (config.current_extension == 0)
-            {
-                carry = (chip8->V[Y] & 0x80) >> 7;
-                chip8->V[X] = chip8->V[Y] << 1;
-            }
-            else
-            {
-                carry = (chip8->V[X] & 0x80) >> 7;
-                chip8->V[X] <<= 1;
-            }
-            chip8->V[0xF] = carry;
-            break;
-
-        default:
-            break;
-        }
-        break;
-
-    case 0x09:
-        // 9XY0 if(Vx != Vy) skip next instruction
-        if (chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y])
-            chip8->PC += 2;
-        break;
-    case 0x0A:
-        // 0xANNN; I (index register) <= NNN
-        chip8->I = chip8->inst.NNN;
-        break;
-
-    case 0x0B:
-        // 0xBNNN: jump to adress NNN + V[0]
-        chip8->PC = chip8->inst.NNN + chip8->V[0];
-        break;
-
-    case 0x0C:
-        // 0xCXNN = VX = rand() % 256 & NN
-        chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
-        break;
-    case 0x0D: {
-            // 0xDXYN: Draw N-height sprite at coords X,Y; Read from memory location I;
-            //   Screen pixels are XOR'd with sprite bits, 
-            //   VF (Carry flag) is set if any screen pixels are set off; This is useful
-            //   for collision detection or other reasons.
-            uint8_t X_coord = chip8->V[chip8->inst.X] % config.window_width;
-            uint8_t Y_coord = chip8->V[chip8->inst.Y] % config.window_height;
-            const uint8_t orig_X = X_coord; // Original X value
-
-            chip8->V[0xF] = 0;  // Initialize carry flag to 0
-
-            // Loop over all N rows of the sprite
-            for (uint8_t i = 0; i < chip8->inst.N; i++) {
-                // Get next byte/row of sprite data
-                const uint8_t sprite_data = chip8->ram[chip8->I + i];
-                X_coord = orig_X;   // Reset X for next row to draw
-
-                for (int8_t j = 7; j >= 0; j--) {
-                    // If sprite pixel/bit is on and display pixel is on, set carry flag
-                    bool *pixel = &chip8->display[Y_coord * config.window_width + X_coord]; 
-                    const bool sprite_bit = (sprite_data & (1 << j));
-
-                    if (sprite_bit && *pixel) {
-                        chip8->V[0xF] = 1;  
-                    }
-
-                    // XOR display pixel with sprite pixel/bit to set it on or off
-                    *pixel ^= sprite_bit;
-
-                    // Stop drawing this row if hit right edge of screen
-                    if (++X_coord >= config.window_width) break;
-                }
-
-                // Stop drawing entire sprite if hit bottom edge of screen
-                if (++Y_coord >= config.window_height) break;
-            }
-            chip8->draw = true;
-            break;
-        }
-    case 0x0E: // input handling
-        if (chip8->inst.NN == 0x9E)
-        {
-            // 0xEX9E: Skip next instruction if key in VX is pressed
-            if (chip8->keypad[chip8->V[chip8->inst.X]])
-                chip8->PC += 2;
-        }
-        else if (chip8->inst.NN == 0xA1)
-        {
-            // 0xEX9E: Skip next instruction if key in VX is not pressed
-            if (!chip8->keypad[chip8->V[chip8->inst.X]])
-                chip8->PC += 2;
-        }
-        break;
-
-    case 0x0F:
-        switch (chip8->inst.NN)
-        {
-        case 0x0A:
-            // 0x0FX0A : VX = get_key(); wait until a keypress then store it in VX
-            static uint8_t key = 0xFF;
-            static bool key_pressed = false;
-            for (uint8_t i = 0; key == 0xFF && i < 16; i++)
-            {
-                if (chip8->keypad[i])
-                {
-                    key_pressed = true;
-                    key = i;
-                    break;
-                }
-            }
-            if (!key_pressed)
-                chip8->PC -= 2; // waits until a keypress
-            else
-            {
-                if (chip8->keypad[key])
-                    chip8->PC -= 2;
-                else
-                {
-                    chip8->V[chip8->inst.X] = key; // VX = key
-                    key = 0xFF;                    // reset to key not foundd
-                    key_pressed = false;
-                }
-            }
-            break;
-
-        case 0x1E:
-            // 0xFX1E: I += VX
-            chip8->I += chip8->V[chip8->inst.X];
-            break;
-
-        case 0x07:
-            // 0xFX07: VX = delay timer
-            chip8->V[chip8->inst.X] = chip8->delay_timer;
-            break;
-
-        case 0x15:
-            // 0xFX15: delay timer = VX
-            chip8->delay_timer = chip8->V[chip8->inst.X];
-            break;
-
-        case 0x18:
-            // 0xFX18: sound timer = VX
-            chip8->sound_timer = chip8->V[chip8->inst.X];
-            break;
-
-        case 0x29:
-            // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
-            chip8->I = chip8->V[chip8->inst.X] * 5;
-            break;
-
-        case 0x33:
-            // stores the BCD representaiton of VX, I = hundrend's digit, I+1 = ten's digit, i+2 = one's digit
-            uint8_t bcd = chip8->V[chip8->inst.X];
-            chip8->ram[chip8->I + 2] = bcd % 10;
-            bcd /= 10;
-            chip8->ram[chip8->I + 1] = bcd % 10;
-            bcd /= 10;
-            chip8->ram[chip8->I] = bcd;
-            break;
-
-        case 0x55:
-            // 0xFX55: registry dump from 0 to X, starting from adress I. I is left unmodified
-            //  SCHIP increments I, chip8 doesnt increment I
-            for (uint8_t i = 0; i <= chip8->inst.X; i++)
-            {
-                if (config.current_extension == 0)
-                    chip8->ram[chip8->I++] = chip8->V[i];
-                else
-                    chip8->ram[chip8->I + i] = chip8->V[i];
-            }
-            break;
-        case 0x65:
-            // 0xFX65: registry load from 0 to X, starting from adress I. I is left unmodified
-            for (uint8_t i = 0; i <= chip8->inst.X; i++)
-            {
-                if (config.current_extension == 0)
-                    chip8->V[i] = chip8->ram[chip8->I++]; // Increment I each time
-                else
-                    chip8->V[i] = chip8->ram[chip8->I + i];
-            }
-            break;
-        default:
-            break;
-        }
-        break;
-    default:
-        // puts("Unimplemented or invalid opcode");
-        break;
-    }
-}
-
-void update_timers(chip8_t *chip8)
-{
-    if (chip8->delay_timer > 0)
-        chip8->delay_timer--;
-    if (chip8->sound_timer > 0)
-        chip8->sound_timer--;
-    // to play osund;
-}
-
 int main(int argc, char **argv)
 {
-    srand(time(NULL));
     // Usage message for agcs
     if (argc < 2)
     {
         printf("Usage: %s <rom_name>\n", argv[0]);
         return -1;
     }
-    (void)argc;
-    (void)argv;
     // Initialise emulator config
     config_t config = {0};
     if (!set_config_from_args(&config, argc, argv))
@@ -822,57 +361,138 @@ int main(int argc, char **argv)
 
     // Initialize SDL
     sdl_t sdl = {0};
-    if (!init_sdl(&sdl, config))
+    if (!init_sdl(&sdl, &config))
         return -1;
 
     // Init chip8 machine
-    chip8_t chip8 = {0};
+    static chip8_t chip8; // Predecoded code and 64 KB of XO-CHIP RAM: too big for the stack
     char *rom_name = argv[1];
-    if (!init_chip8(&chip8, rom_name))
+    if (!init_chip8(&chip8, &config, rom_name))
     {
         printf("initializaton failed\n");
         return -1;
     }
-    clear_screen(sdl, config);
+    const uint64_t seed = time(NULL);
+    seed_chip8(&chip8, seed);
+    clear_screen(&sdl, &config);
+
+    // Sound, played by SDL's audio thread from what each frame pushes
+    static audio_t audio;
+    if (open_audio(&sdl, &audio))
+        chip8.audio = &audio;
+
+    // --record file logs the keypad and seed for replay in the headless runner
+    input_log_t log = {0};
+    for (int i = 2; i < argc - 1; i++)
+    {
+        if (!strcmp(argv[i], "--record") && !start_recording(&log, argv[i + 1], &chip8, &config, seed))
+            return -1;
+    }
 
-    // Main emulator loop
+    // --trace keeps the last instructions executed, see quick_trace
+    trace_t trace = {0};
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--trace"))
+        {
+            if (!init_trace(&trace, TRACE_ENTRIES))
+                return -1;
+            chip8.trace = &trace;
+        }
+    }
+
+    // Debugger: --debug attaches it with nothing armed, see debug_keys
+    static debugger_t debug;
+    for (int i = 2; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const bool debug_arg = !strcmp(arg, "--debug") || !strcmp(arg, "--watch-i") ||
+                               (i + 1 < argc && (!strcmp(arg, "--break") || !strcmp(arg, "--watch") || !strcmp(arg, "--run-to")));
+        if (!debug_arg)
+            continue;
+        if (log.recording)
+        {
+            printf("The debugger stops mid-frame, which an input log cannot replay: not with --record\n");
+            return -1;
+        }
+        if (!chip8.debug)
+            attach_debugger(&chip8, &debug);
+        if (!strcmp(argv[i], "--break"))
+            set_breakpoint(&chip8, strtoul(argv[++i], NULL, 0), true);
+        else if (!strcmp(argv[i], "--watch"))
+            set_watchpoint(&chip8, strtoul(argv[++i], NULL, 0), true);
+        else if (!strcmp(argv[i], "--watch-i"))
+            set_watch_i(&chip8, true);
+        else if (!strcmp(argv[i], "--run-to"))
+            run_to_frame(&chip8, strtoull(argv[++i], NULL, 0));
+    }
+
+    // Rewind history, allocated once
+    static rewind_t rw; // Holds a 64 KB snapshot
+    if (!init_rewind(&rw, REWIND_SECONDS * FRAME_RATE, REWIND_BYTES))
+        return -1;
+    rewind_record(&rw, &chip8);
+    bool rewinding = false;
+
+    // Main emulator loop: input is polled right before the frames that see it, every 60hz
+    // frame that is due runs (CPU and timers), then the display is presented once if it changed
+    scheduler_t sched;
+    init_scheduler(&sched, clock_ns());
     while (chip8.state != QUIT)
     {
         // Handle user input
-        handle_input(&chip8);
+        handle_input(&chip8, &config, &rewinding, log.recording);
         if (chip8.state == PAUSED)
+        {
+            if (chip8.dirty_rows) // Debugger steps
+            {
+                update_screen(&sdl, &config, get_framebuffer(&chip8));
+                chip8.dirty_rows = 0;
+            }
+            SDL_Delay(16);
+            init_scheduler(&sched, clock_ns()); // Resume without a catch-up burst
             continue;
+        }
 
-
-        uint32_t start_time = SDL_GetTicks();
-
-        // Emulate CHIP8 instructions for this frame (60 hz)
-        for (uint32_t i = 0; i < config.instructions_per_second / 60; i++)
-            emulate_instruction(&chip8, config);
-
-
-        uint32_t end_time = SDL_GetTicks();
-
-        // Delay for aprox 60Hz
-        double time_elapsed = (double)(end_time - start_time) / 1000;
-
-        if (16.67f > time_elapsed)
+        // Every due frame either runs and joins the history, or steps back through it
+        for (uint32_t due = scheduler_due(&sched, clock_ns()); due; due--)
         {
-            SDL_Delay(16.67f - time_elapsed); 
-        }
-        else{
-            SDL_Delay(0);  
+            if (rewinding)
+                rewind_step(&rw, &chip8);
+            else
+            {
+                if (log.recording)
+                    record_input(&log, &chip8);
+                emulate_frame(&chip8, &config);
+                if (chip8.debug && chip8.debug->stopped)
+                {
+                    print_debug_stop(&chip8, stdout);
+                    break; // Mid-frame, kept out of the rewind history
+                }
+                rewind_record(&rw, &chip8);
+            }
         }
-        // Update window with changes on every iteration
-        if(chip8.draw)
+
+        // Update window with changes, at most once per wakeup however many frames ran
+        if (chip8.dirty_rows)
         {
-            update_screen(sdl, config, chip8);
-            chip8.draw = false;
+            update_screen(&sdl, &config, get_framebuffer(&chip8));
+            chip8.dirty_rows = 0;
         }
-        update_timers(&chip8);
+
+        wait_until(scheduler_next_ns(&sched));
     }
     // Final cleanup
-    final_cleanup(sdl);
+#ifdef PROFILE
+    print_profile(&chip8, stdout);
+#endif
+    print_fault(&chip8, stdout);
+    stop_input_log(&log, &chip8);
+    quick_trace(&chip8);
+    release_trace(&trace);
+    release_rewind(&rw);
+    release_chip8(&chip8);
+    final_cleanup(&sdl);
 
     exit(EXIT_SUCCESS);
     return 0;
@@ -1,12 +1,74 @@
 #ifndef CHIP8_H
 #define CHIP8_H
-#include "SDL.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
+#define DISPLAY_WIDTH 64  // CHIP8 X RESOLUTION
+#define DISPLAY_HEIGHT 32 // Y
+#define HIRES_WIDTH 128   // SCHIP and XO-CHIP high resolution
+#define HIRES_HEIGHT 64
+#define DISPLAY_WORDS (HIRES_WIDTH / 64) // 64 pixel words per row, enough for high resolution
+#define DISPLAY_PLANES 2                 // XO-CHIP bitplanes, the other machines use the first
+#define DISPLAY_ALL_ROWS (~0ULL)         // Every row of either resolution
+#define STACK_DEPTH 12    // Nested calls
+#define RAM_SIZE 0x1000   // CHIP8 and SCHIP address space, and where code runs on every machine
+#define XO_RAM_SIZE 0x10000 // XO-CHIP address space, the upper 60 KB only hold data
+#define ENTRY_POINT 0x200 // Where programs start
+#define BIG_FONT 0x50     // SCHIP 8x10 digits, after the 4x5 ones at 0
+
+// Machine to emulate. Each runs the opcodes of the ones before it
+typedef enum
+{
+    EXT_CHIP8,
+    EXT_SCHIP,  // 128x64 mode, scrolling, 16x16 sprites, big font, flag registers
+    EXT_XOCHIP, // 64 KB RAM, two bitplanes, long I, register ranges
+} extension_t;
+
+#define EXT_RAM_SIZE(extension) ((extension) == EXT_XOCHIP ? XO_RAM_SIZE : RAM_SIZE)
+
+// Named sets of quirks, the behaviors ROMs for different platforms rely on
+typedef enum
+{
+    QUIRKS_VIP,    // COSMAC VIP, the original interpreter
+    QUIRKS_CHIP48, // HP-48 CHIP-48
+    QUIRKS_SCHIP,  // SUPER-CHIP 1.1
+    QUIRKS_XOCHIP, // Octo
+} quirk_profile_t;
+
+typedef enum
+{
+    LOAD_STORE_INC_X1, // FX55/FX65 leave I past the last register
+    LOAD_STORE_INC_X,  // I += X, one short (CHIP-48)
+    LOAD_STORE_KEEP,   // I is left unmodified
+} load_store_t;
+
+// Each quirk picks between handler variants when instructions are decoded, see decode_instruction
 typedef struct
 {
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-} sdl_t;
+    bool vf_reset;           // 8XY1/8XY2/8XY3 clear VF
+    bool shift_vx;           // 8XY6/8XYE shift VX in place instead of VY into VX
+    load_store_t load_store; // What FX55/FX65 do to I
+    bool jump_vx;            // BXNN jumps to XNN + VX instead of BNNN to NNN + V0
+    bool wrap;               // Sprites wrap around the screen edges instead of being clipped
+} quirks_t;
+
+typedef enum
+{
+    ENGINE_DECODE, // Fetch and decode every instruction (reference)
+    ENGINE_CACHED, // Predecoded instruction cache indexed by PC
+    ENGINE_BLOCK,  // Basic blocks run as chains of predecoded handlers
+    ENGINE_JIT,    // Block engine with hot blocks compiled to x86-64 (JIT builds only)
+} engine_t;
+
+// What a frame's budget counts
+typedef enum
+{
+    TIMING_FLAT, // Instructions, instructions_per_second / 60 per frame, all the same cost
+    TIMING_VIP,  // COSMAC VIP machine cycles, each instruction charged what it takes there
+} timing_t;
 
 typedef struct
 {
@@ -14,9 +76,16 @@ typedef struct
     int window_width;
     int fg_color; // foregroud 0xRRGGBBAA
     int bg_color; // background 0xRRGGBBAA
+    int fg2_color;   // XO-CHIP: pixels set in the second plane only
+    int blend_color; // XO-CHIP: pixels set in both planes
     uint32_t scale_factor;
     uint32_t instructions_per_second; // CHIP8 CPU instructions per seconds
-    uint32_t current_extension; //0 = CHIP8
+    extension_t current_extension; // Machine the ROM is for, fixed once a machine is initialized
+    quirk_profile_t quirk_profile; // --quirks, defaults to the machine's own
+    quirks_t quirks;               // The profile's quirks
+    engine_t engine;            // How instructions are dispatched
+    timing_t timing;            // --timing flat|vip
+    bool vsync;                 // SDL frontend: wait for the display refresh on present
 } config_t;
 
 typedef enum
@@ -25,35 +94,476 @@ typedef enum
     RUNNING,
     PAUSED,
 } emulator_state_t;
-// CHIP8 instruction format
+
+// Guest accesses a CHECKED build traps (core.c): the machine halts on the instruction instead
+typedef enum
+{
+    FAULT_NONE,
+    FAULT_FETCH,           // Instruction straddles the end of the code space (PC 0xFFF, F000 NNNN at 0xFFE)
+    FAULT_RAM_READ,        // Bytes read past the end of RAM (FX65, 5XY3, F002, DXYN sprite data)
+    FAULT_RAM_WRITE,       // Bytes written past the end of RAM (FX55, FX33, 5XY2)
+    FAULT_STACK_OVERFLOW,  // 2NNN with STACK_DEPTH return addresses already on the stack
+    FAULT_STACK_UNDERFLOW, // 00EE with an empty stack
+    FAULT_KEY,             // EX9E/EXA1 with VX above 0xF
+} fault_reason_t;
+
 typedef struct
 {
+    fault_reason_t reason;
+    uint16_t pc;      // Faulting instruction
+    uint16_t opcode;
+    uint32_t address; // RAM address, stack depth or key, by reason
+} fault_t;
+
+// What a block runs for each of its instructions. Common non-terminating ops are emulated
+// inline by the block engine (and compiled by the JIT), everything else calls the predecoded handler
+typedef enum
+{
+    BOP_HANDLER,
+    BOP_6XNN,
+    BOP_7XNN,
+    BOP_8XY0,
+    BOP_8XY1,
+    BOP_8XY2,
+    BOP_8XY3,
+    BOP_8XY4,
+    BOP_8XY5,
+    BOP_8XY7,
+    BOP_ANNN,
+    BOP_FX1E,
+    // Flag-free variants, used when VF is overwritten later in the block before anything reads it
+    BOP_8XY1_NF,
+    BOP_8XY2_NF,
+    BOP_8XY3_NF,
+    BOP_8XY4_NF,
+    BOP_8XY5_NF,
+    BOP_8XY7_NF,
+    // Skips (3XNN 4XNN 5XY0 9XY0 EX9E EXA1) over a plain instruction: the block goes on, the
+    // next entry is passed over when the skip is taken
+    BOP_SKIP_EQ,
+    BOP_SKIP_NE,
+    BOP_SKIP_EQ_V,
+    BOP_SKIP_NE_V,
+    BOP_SKIP_KEY,
+    BOP_SKIP_NO_KEY,
+    // 2NNN followed into the callee: pushes the return address, the block goes on at NNN
+    BOP_CALL,
+    // 1NNN, only kept in PROFILE builds so the jump is counted; elsewhere a followed jump
+    // leaves no entry, the block just goes on at NNN
+    BOP_JUMP,
+    // The block's last instruction: sets PC past it and calls its handler
+    BOP_TERMINATOR,
+} block_op_t;
+
+// One instruction of a translated block, operands copied from its predecoded instruction
+typedef struct
+{
+    uint8_t op; // block_op_t
+    uint8_t X;
+    uint8_t Y;
+    uint8_t NN;
+    uint16_t NNN;
+    uint16_t pc; // Its address, the handler ops call icache[pc]
+} block_entry_t;
+
+#define BLOCK_MAX 64     // Entries in one block, a block that would run longer ends there
+#define BLOCK_CODE 8192  // Entries of translated code; when they run out every block is dropped
+
+typedef struct chip8 chip8_t;
+typedef struct instruction instruction_t;
+typedef void (*opcode_handler_t)(chip8_t *chip8, const instruction_t *inst, const config_t *config);
+
+#ifdef JIT
+// A compiled block: runs it whole, returns the entries taken skips passed over
+typedef uint16_t (*jit_code_t)(chip8_t *chip8, const config_t *config);
+
+// Native code for hot blocks (jit_x86.c)
+typedef struct
+{
+    jit_code_t code[0x1000]; // Compiled block starting at each address, NULL = none
+    uint8_t hits[0x1000];    // Block executions counted towards compilation
+    uint8_t *buffer;         // Code buffer, mapped on first compile: writable while compiling, executable otherwise
+    size_t used;
+} jit_t;
+#endif
+
+#ifdef PROFILE
+typedef struct
+{
+    uint64_t count;  // Instructions executed
+    uint64_t cycles; // Host clock ticks spent in them
+} profile_counter_t;
+
+// Execution profile of a machine (PROFILE builds only, see profile.c)
+typedef struct
+{
+    profile_counter_t family[16];  // By first opcode nibble
+    profile_counter_t pc[0x1000];  // By address
+    uint16_t opcode[0x1000];       // Last opcode executed at each address
+    uint64_t draws;                // DXYN executed
+    uint64_t pixels;               // Sprite pixels they drew, clipped pixels excluded
+    uint64_t frames;               // 60hz frames (timer ticks)
+    uint64_t draw_frames;          // Frames that drew or cleared the screen
+    bool drew;                     // Current frame drew
+} profile_t;
+#endif
+
+#define TRACE_VERSION 1
+#define TRACE_ENTRIES (1u << 20) // Default trace length, 8 MB
+
+// What one traced instruction left behind (trace.c)
+typedef struct
+{
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t vx; // VX after the instruction
+    uint8_t vf;
+} trace_entry_t;
+
+// Ring of the last instructions executed
+typedef struct trace
+{
+    trace_entry_t *entries;
+    uint32_t mask;  // Entries - 1, a power of two
+    uint64_t steps; // Instructions traced so far, the newest is at (steps - 1) & mask
+} trace_t;
+
+#define AUDIO_RATE 48000   // Output samples per second
+#define AUDIO_PATTERN 16   // Bytes of the 1 bit sample pattern sound plays (XO-CHIP F002)
+#define AUDIO_PITCH 64     // Default pattern pitch (FX3A): 4000 pattern bits per second
+#define AUDIO_RING 32      // Frames of sound in flight between the machine and the output, a power of two
+#define AUDIO_MAX_LAG 4    // Frames the output may fall behind before it skips ahead
+#define AUDIO_VOLUME 4000  // Amplitude of a set pattern bit, in 16 bit samples
+
+// What the sound hardware did during one frame
+typedef struct
+{
+    bool on; // The sound timer was running
+    uint8_t pitch;
+    uint8_t pattern[AUDIO_PATTERN];
+} audio_frame_t;
+
+// Sound pipeline (audio.c): the machine pushes one audio_frame_t per frame into a single
+// producer, single consumer ring, and the output (an SDL callback, or a sink on the
+// emulation thread) turns them into samples. Neither side ever waits for the other
+typedef struct audio
+{
+    audio_frame_t frames[AUDIO_RING];
+    _Alignas(64) _Atomic uint32_t head; // Frames pushed, written by the producer only
+    uint64_t dropped;                   // Producer: frames lost to a full ring
+    _Alignas(64) _Atomic uint32_t tail; // Frames consumed, written by the consumer only
+    uint32_t rate;                      // Consumer state from here on: samples per second
+    uint32_t frame_samples;             // Samples per frame
+    uint32_t left;                      // Samples left of the frame being played
+    audio_frame_t current;              // Frame being played, held if the ring runs dry
+    uint32_t held;                      // Frames played since the ring last had one
+    uint32_t phase;                     // Position in the 128 bit pattern, 7.25 fixed point
+    uint32_t steps[256];                // Phase increment per sample for each pitch
+    uint64_t underruns;                 // Frames played with no new frame available
+    uint64_t skipped;                   // Frames skipped to catch up
+} audio_t;
+
+// Headless audio output: samples go to a WAV file, or nowhere for a null sink
+typedef struct
+{
+    FILE *file;       // NULL = null sink
+    uint32_t rate;    // Samples per second
+    int16_t *buffer;  // One frame of samples
+    uint64_t samples; // Rendered so far
+} audio_sink_t;
+
+// Why a debugger stopped the machine
+typedef enum
+{
+    DEBUG_NONE,
+    DEBUG_USER,       // Asked to, between frames
+    DEBUG_BREAKPOINT, // Before the instruction at PC
+    DEBUG_WATCH_RAM,  // After an instruction wrote a watched byte
+    DEBUG_WATCH_I,    // After an instruction changed I
+    DEBUG_FRAME,      // At the start of the frame run-to-frame asked for
+    DEBUG_STEP,       // After a single step
+} debug_reason_t;
+
+// Breakpoints and watchpoints of a machine (debug.c). Nothing is checked per instruction:
+// armed addresses get a trap handler in place of their predecoded instruction, and watched
+// bytes share the RAM write check that keeps translated code in sync
+typedef struct debugger
+{
+    bool breakpoints[RAM_SIZE];
+    bool watched[RAM_SIZE]; // Stop after writes to these bytes
+    bool watch_i;           // Stop after any change of I
+    uint64_t run_to_frame;  // Stop when this frame starts, 0 = none
+    bool stopped;           // The machine is stopped, state PAUSED
+    debug_reason_t reason;
+    uint16_t address;       // Breakpoint or watched byte that stopped it
+    uint16_t old_I;         // I before the change that stopped it
+    bool stop_pending;      // A watchpoint hit: park on stop_pc like on a breakpoint
+    uint16_t stop_pc;
+    uint32_t parked;        // Dispatches of this frame that hit a stop instead of running
+    uint32_t parked_cycles; // The VIP cycles they were charged
+} debugger_t;
+
+// CHIP8 instruction format
+struct instruction
+{
+    opcode_handler_t handler; // Emulates this opcode, NULL = not decoded yet
     uint16_t opcode;
     uint16_t NNN; // 12 bit  Adress / constnat
     uint8_t NN;   // 8bit const
     uint8_t N;    // 4bit const
     uint8_t X;    // 4 bit register identifier(V0-VF)
     uint8_t Y;    // 4 bit register identifier(V0-VF)
+    uint16_t cycles; // VIP timing: machine cycles it costs, fetch and decode included
 
     // inst.X, inst.NNN;
-} instruction_t;
+};
 
-typedef struct
+struct chip8
 {
     emulator_state_t state;
-    uint8_t ram[0x1000];
-    bool display[64 * 32]; // &ram[0XF00]
-    uint16_t stack[12];    // call stack
-    uint16_t *stack_ptr;   // Self explanatory
+    uint8_t ram[XO_RAM_SIZE];     // EXT_RAM_SIZE(extension) bytes used
+    // [plane][word][row]: pixels 64 * word to 64 * word + 63 of a row, bit 63 = leftmost.
+    // Low resolution uses the first word of the first 32 rows
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][HIRES_HEIGHT];
+    extension_t extension; // Copied from the config at init, RAM and save states depend on it
+    bool hires;            // SCHIP 128x64 mode
+    uint8_t planes;        // XO-CHIP: planes drawing, clearing and scrolling apply to, bit p = plane p
+    uint8_t rpl[16];       // SCHIP flag registers (FX75, FX85)
+    uint8_t pattern[AUDIO_PATTERN]; // Sound sample pattern (XO-CHIP F002, a square wave elsewhere)
+    uint8_t pitch;         // Pattern playback pitch (XO-CHIP FX3A)
+    uint16_t stack[STACK_DEPTH]; // call stack
+    uint8_t stack_depth;   // Return adresses on the stack
     uint8_t V[16];         // Data registers V0-VF. (F = flags)
     uint16_t I;            // Adress register, 12 bits wide (Index register?)
     uint16_t PC;           // Program Counter
     uint8_t delay_timer;   // Decrements at 60hz when >0
     uint8_t sound_timer;   // Decremets at 60hz when >0and will play a tone when >0
     bool keypad[16];       // Hexadecimal keypad 0x0-0xF;
+    uint8_t wait_key;      // FX0A: key pressed and waiting for release, 0xFF = none yet
     char *rom_name;        // Currently running ROM
-    instruction_t inst;
-    bool draw;
-} chip8_t;
+    uint64_t frame;        // 60hz frames emulated so far
+    uint64_t rng;          // CXNN random generator state (xorshift64*)
+    trace_t *trace;        // Instruction trace being recorded, NULL = off
+    debugger_t *debug;     // Attached debugger, NULL = none
+    audio_t *audio;        // Sound output, NULL = silent
+    fault_t fault;         // First access a CHECKED build trapped, FAULT_NONE otherwise
+    uint32_t frame_done;   // Instructions of the current frame run so far: before a debugger
+                           // stopped it, or between frames what the last block ran past the frame
+    int32_t cycles;        // VIP timing: machine cycles left in the current frame, below 0 once overrun
+    uint64_t dirty_rows; // Display rows changed since the last render, bit y = row y
+    instruction_t icache[0x1000]; // Predecoded instruction for each RAM address, indexed by PC
+    uint64_t decoded[0x1000 / 64];  // icache slots decoded since the last invalidate_code, the only ones it clears
+    uint16_t block_len[0x1000];         // Instructions the block at each address runs when no skip in it is taken, 0 = not translated
+    uint16_t block_start[0x1000];       // Its first entry in block_code
+    uint8_t block_entries[0x1000];      // Its entries, the terminator last
+    uint32_t block_cycles[0x1000];      // VIP cycles of the block's instructions before its terminator
+    uint16_t block_used;                // Entries of block_code in use
+    block_entry_t block_code[BLOCK_CODE]; // Translated blocks, each a run of entries ending with BOP_TERMINATOR
+    uint8_t ram_traps[0x1000];          // RAM bytes whose writes need more than a store (TRAP_*)
+#ifdef JIT
+    jit_t jit;
+#endif
+#ifdef PROFILE
+    profile_t profile;
+#endif
+};
+
+// Read-only view of the display, all a renderer needs from the machine
+typedef struct
+{
+    const uint64_t *rows[DISPLAY_PLANES][DISPLAY_WORDS]; // rows[plane][x / 64][y], bit 63 = leftmost pixel
+    uint32_t width;      // 64 or 128
+    uint32_t height;     // 32 or 64
+    uint32_t planes;     // Planes the machine has, a pixel's color is its bit in each
+    uint64_t dirty_rows; // Rows changed since the last render
+} framebuffer_t;
+
+#define FRAME_RATE 60        // Timer and frame rate, Hz
+#define SCHEDULER_CATCHUP 4  // Most frames run at once after falling behind, the rest are dropped
+
+// Fixed-timestep scheduler. Frame n is due at origin + n / FRAME_RATE seconds on whatever
+// monotonic clock the frontend uses; frames are only ever emulated whole, so the machine
+// state depends on the number of frames run and never on how late they ran
+typedef struct
+{
+    uint64_t origin_ns; // Clock time frame 0 was due
+    uint64_t slots;     // Frames scheduled so far, run or dropped
+    uint64_t dropped;   // Frames skipped because the host fell too far behind
+} scheduler_t;
+
+#define SAVESTATE_VERSION 6
+#define SAVESTATE_REGS_SIZE 111 // Serialized registers, timers, stack, keypad, frame, RNG, display mode, sound, VIP cycles and frame progress
+#define RAM_PAGE 64            // Granularity of RAM in snapshot deltas
+#define SAVESTATE_MAX_SIZE (8 + SAVESTATE_REGS_SIZE + 8 + sizeof(((chip8_t *)0)->display) + \
+                            XO_RAM_SIZE / RAM_PAGE / 8 + XO_RAM_SIZE)
+
+// Last state written or read in a chain of save states, what the next delta is taken against
+typedef struct
+{
+    uint8_t regs[SAVESTATE_REGS_SIZE];
+    uint64_t display[DISPLAY_PLANES][DISPLAY_WORDS][HIRES_HEIGHT];
+    uint8_t ram[XO_RAM_SIZE];
+    bool valid; // False until the first (complete) state of the chain
+} snapshot_t;
+
+#define REWIND_KEYFRAME 60        // Frames between complete states in the rewind history
+#define REWIND_SECONDS 60         // Default history length
+#define REWIND_BYTES (3u << 20)   // Default state budget, with the index under 4 MB for REWIND_SECONDS
+
+typedef struct rewind_entry rewind_entry_t;
+
+// Rewind history of the last frames, bounded by a byte budget fixed at init
+typedef struct
+{
+    uint8_t *arena;            // The only allocation: entry index, then the state ring
+    rewind_entry_t *entries;   // Index ring, one entry per frame
+    uint32_t max_entries;
+    uint32_t first;            // Oldest entry
+    uint32_t count;
+    uint32_t since_keyframe;   // Deltas recorded since the last complete state
+    uint8_t *ring;             // Save states, back to back
+    size_t ring_size;
+    size_t write;              // Where the next state goes
+    snapshot_t snap;           // Newest state, what the next delta is taken against
+} rewind_t;
+
+#define INPUT_VERSION 4
+
+// Keypad log being recorded or replayed
+typedef struct
+{
+    FILE *file;
+    bool recording;
+    bool ended;         // Replay: the end of the log has been read
+    uint16_t keys;      // Record: keypad at the last event
+    uint16_t next_keys; // Replay: keypad of the next event
+    uint64_t frame;     // Frame of the last event written, or of the next event to replay
+    uint64_t seed;
+    uint32_t instructions_per_second;
+} input_log_t;
+
+// Shared, read-only initial RAM of one ROM, see romstore.c
+typedef struct
+{
+    uint64_t hash;          // Of the file contents
+    size_t size;            // Of the program
+    extension_t extension;  // Machine the image is for
+    const uint8_t *ram;     // EXT_RAM_SIZE(extension) bytes: fonts, program at ENTRY_POINT, zeros
+    const uint8_t *program; // The program inside ram
+} rom_image_t;
+
+typedef struct
+{
+    rom_image_t **roms;
+    size_t count;
+    size_t cap;
+} rom_store_t;
+
+// Core (core.c) - no SDL dependency, shared by the SDL frontend and the headless runner
+extern const char *const extension_names[];
+extern const char *const quirk_profile_names[];
+extern const quirks_t quirk_profiles[];
+extern const quirk_profile_t default_quirk_profiles[]; // Indexed by extension_t, as --extension takes them
+bool set_config_from_args(config_t *config, int argc, char **argv);
+bool init_chip8(chip8_t *chip8, const config_t *config, char rom_name[]);
+bool init_chip8_from_memory(chip8_t *chip8, const config_t *config, const uint8_t *rom_data, size_t rom_size, char rom_name[]);
+bool build_ram_image(uint8_t *image, extension_t extension, const uint8_t *rom_data, size_t rom_size, const char *rom_name);
+void init_chip8_from_image(chip8_t *chip8, const config_t *config, const uint8_t *image, char rom_name[]);
+void seed_chip8(chip8_t *chip8, uint64_t seed);
+void invalidate_code(chip8_t *chip8);
+void decode_instruction(const chip8_t *chip8, const config_t *config, uint16_t opcode, instruction_t *inst);
+void emulate_instruction(chip8_t *chip8, const config_t *config);
+uint32_t emulate_instructions(chip8_t *chip8, const config_t *config, uint32_t count);
+uint32_t emulate_frame(chip8_t *chip8, const config_t *config);
+void update_timers(chip8_t *chip8);
+uint64_t hash_display(const chip8_t *chip8);
+void release_chip8(chip8_t *chip8);
+uint32_t emulate_block(chip8_t *chip8, const config_t *config);
+framebuffer_t get_framebuffer(const chip8_t *chip8);
+void step_instruction(chip8_t *chip8, const config_t *config);
+void debug_stop(chip8_t *chip8, debug_reason_t reason, uint16_t address);
+void init_scheduler(scheduler_t *sched, uint64_t now_ns);
+uint32_t scheduler_due(scheduler_t *sched, uint64_t now_ns);
+uint64_t scheduler_next_ns(const scheduler_t *sched);
+
+// Save states (savestate.c)
+size_t save_state(const chip8_t *chip8, snapshot_t *snap, uint8_t *buf, size_t cap);
+bool load_state(chip8_t *chip8, snapshot_t *snap, const uint8_t *buf, size_t size);
+bool apply_state(snapshot_t *snap, const uint8_t *buf, size_t size, extension_t extension);
+void restore_snapshot(chip8_t *chip8, const snapshot_t *snap);
+
+// Rewind (rewind.c)
+bool init_rewind(rewind_t *rw, uint32_t frames, size_t ring_size);
+void release_rewind(rewind_t *rw);
+void rewind_record(rewind_t *rw, const chip8_t *chip8);
+bool rewind_step(rewind_t *rw, chip8_t *chip8);
+size_t rewind_used(const rewind_t *rw);
+
+// Input logs (input.c)
+bool start_recording(input_log_t *log, const char *path, const chip8_t *chip8, const config_t *config, uint64_t seed);
+void record_input(input_log_t *log, const chip8_t *chip8);
+bool start_replay(input_log_t *log, const char *path, chip8_t *chip8, config_t *config);
+bool replay_input(input_log_t *log, chip8_t *chip8);
+void stop_input_log(input_log_t *log, const chip8_t *chip8);
+
+// Instruction traces (trace.c)
+bool init_trace(trace_t *trace, uint32_t entries);
+void release_trace(trace_t *trace);
+bool dump_trace(const trace_t *trace, const char *path);
+void disassemble(uint16_t opcode, char *buf, size_t size);
+
+// Sound (audio.c)
+void init_audio(audio_t *audio, uint32_t rate);
+void push_audio(audio_t *audio, const chip8_t *chip8);
+void render_audio(audio_t *audio, int16_t *out, size_t samples);
+bool open_audio_sink(audio_sink_t *sink, const audio_t *audio, const char *path);
+void drain_audio(audio_t *audio, audio_sink_t *sink);
+void close_audio_sink(audio_sink_t *sink);
+
+// Debugger (debug.c)
+void attach_debugger(chip8_t *chip8, debugger_t *debug);
+void detach_debugger(chip8_t *chip8);
+void set_breakpoint(chip8_t *chip8, uint16_t address, bool armed);
+void set_watchpoint(chip8_t *chip8, uint16_t address, bool armed);
+void set_watch_i(chip8_t *chip8, bool armed);
+void run_to_frame(chip8_t *chip8, uint64_t frame);
+void debug_break(chip8_t *chip8);
+void debug_step(chip8_t *chip8, const config_t *config);
+void debug_continue(chip8_t *chip8, const config_t *config);
+void print_debug_stop(const chip8_t *chip8, FILE *out);
+void print_fault(const chip8_t *chip8, FILE *out);
+
+// Debug server (debugserver.c, POSIX, headless runner only)
+typedef struct debug_server debug_server_t;
+debug_server_t *start_debug_server(const char *path);
+void poll_debug_server(debug_server_t *server, chip8_t *chip8, const config_t *config);
+void stop_debug_server(debug_server_t *server);
+
+// Fuzzer (fuzz.c, POSIX, headless runner only)
+#define FUZZ_BUDGET 1000 // Default instructions per fuzzer run
+int fuzz(const config_t *config, const char *out_dir, int nworkers, uint64_t seconds, uint64_t budget,
+         int nseeds, char **seeds);
+int fuzz_run(const config_t *config, const char *path, uint64_t budget);
+
+// Golden framebuffer tests (golden.c, headless runner only)
+int run_golden_tests(const config_t *config);
+
+// ROM store (romstore.c, POSIX, headless runner only)
+const rom_image_t *rom_store_add(rom_store_t *store, const char *path, extension_t extension);
+void rom_store_release(rom_store_t *store);
+
+#ifdef PROFILE
+// Profile reports (profile.c)
+void print_profile(const chip8_t *chip8, FILE *out);
+bool write_profile_json(const chip8_t *chip8, const char *path);
+#endif
+
+#ifdef JIT
+// JIT (jit_x86.c)
+bool jit_compile(chip8_t *chip8, uint16_t pc);
+void jit_flush(chip8_t *chip8);
+void jit_release(chip8_t *chip8);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,2332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef PROFILE
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "chip8.h"
+
+const char *const extension_names[] = {
+    [EXT_CHIP8] = "chip8",
+    [EXT_SCHIP] = "schip",
+    [EXT_XOCHIP] = "xochip",
+};
+
+const char *const quirk_profile_names[] = {
+    [QUIRKS_VIP] = "vip",
+    [QUIRKS_CHIP48] = "chip48",
+    [QUIRKS_SCHIP] = "schip",
+    [QUIRKS_XOCHIP] = "xochip",
+};
+
+const quirks_t quirk_profiles[] = {
+    [QUIRKS_VIP] = {.vf_reset = true, .load_store = LOAD_STORE_INC_X1},
+    [QUIRKS_CHIP48] = {.shift_vx = true, .load_store = LOAD_STORE_INC_X, .jump_vx = true},
+    [QUIRKS_SCHIP] = {.shift_vx = true, .load_store = LOAD_STORE_KEEP, .jump_vx = true},
+    [QUIRKS_XOCHIP] = {.load_store = LOAD_STORE_INC_X1, .wrap = true},
+};
+
+// The profile a machine gets without --quirks
+const quirk_profile_t default_quirk_profiles[] = {
+    [EXT_CHIP8] = QUIRKS_VIP,
+    [EXT_SCHIP] = QUIRKS_SCHIP,
+    [EXT_XOCHIP] = QUIRKS_XOCHIP,
+};
+
+// VIP timing (--timing vip). The VIP's 1802 runs 1.7609 MHz, 8 clocks per machine cycle:
+// 3668 cycles per 60 Hz frame, of which the display DMA takes 1024 and the frame interrupt
+// about 50, the interpreter gets the rest. An instruction costs the interpreter's fetch and
+// decode plus its own routine (vip_cycles), carried by the predecoded instruction so the
+// engines charge it as they dispatch; what only shows at run time is charged by the
+// handlers: a skip taken, and the rows a sprite draws. A draw first waits for the vertical
+// blank, which ends the frame, so the sprite's cycles come out of the next one. The figures
+// are approximate, close enough that programs tuned on a VIP run at its pace
+#define VIP_FRAME_CYCLES (3668 - 1024 - 50)
+#define VIP_FETCH_CYCLES 40     // Fetch and decode, every instruction
+#define VIP_SKIP_CYCLES 4       // A skip taken
+#define VIP_DRAW_ROW_CYCLES 18  // A sprite row at a byte aligned X
+#define VIP_DRAW_SHIFT_CYCLES 4 // More per row for each bit X is off the byte
+
+// Iniitial emulator config from passed arguments
+bool set_config_from_args(config_t *config, int argc, char **argv)
+{
+
+    // set default
+    config->window_width = DISPLAY_WIDTH;  // CHIP8 X RESOLUTION
+    config->window_height = DISPLAY_HEIGHT; // Y
+    config->fg_color = 0xFFFFFFFF;
+    config->bg_color = 0x000000FF;
+    config->fg2_color = 0xAAAAAAFF;
+    config->blend_color = 0x555555FF;
+    config->scale_factor = 20;             // 1280x640
+    config->instructions_per_second = 600; // standard speed
+    config->current_extension = EXT_CHIP8; // --extension chip8|schip|xochip
+    config->engine = ENGINE_CACHED;        // Predecoded instruction cache
+    config->timing = TIMING_FLAT;          // --timing vip: COSMAC VIP cycles
+    config->vsync = true;                  // Present in step with the display refresh
+    int profile = -1;                      // --quirks, or the machine's own
+    // override default from args
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--no-vsync"))
+            config->vsync = false;
+        else if (!strcmp(argv[i], "--ips") && i + 1 < argc)
+            config->instructions_per_second = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--engine") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "decode"))
+                config->engine = ENGINE_DECODE;
+            else if (!strcmp(argv[i], "cached"))
+                config->engine = ENGINE_CACHED;
+            else if (!strcmp(argv[i], "block"))
+                config->engine = ENGINE_BLOCK;
+#ifdef JIT
+            else if (!strcmp(argv[i], "jit"))
+                config->engine = ENGINE_JIT;
+#endif
+            else
+            {
+                printf("Unknown engine %s (decode, cached, block)\n", argv[i]);
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "--timing") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "flat"))
+                config->timing = TIMING_FLAT;
+            else if (!strcmp(argv[i], "vip"))
+                config->timing = TIMING_VIP;
+            else
+            {
+                printf("Unknown timing %s (flat, vip)\n", argv[i]);
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "--extension") && i + 1 < argc)
+        {
+            i++;
+            if (!strcmp(argv[i], "chip8"))
+                config->current_extension = EXT_CHIP8;
+            else if (!strcmp(argv[i], "schip"))
+                config->current_extension = EXT_SCHIP;
+            else if (!strcmp(argv[i], "xochip"))
+                config->current_extension = EXT_XOCHIP;
+            else
+            {
+                printf("Unknown extension %s (chip8, schip, xochip)\n", argv[i]);
+                return false;
+            }
+        }
+        else if (!strcmp(argv[i], "--quirks") && i + 1 < argc)
+        {
+            i++;
+            for (quirk_profile_t q = QUIRKS_VIP; q <= QUIRKS_XOCHIP; q++)
+            {
+                if (!strcmp(argv[i], quirk_profile_names[q]))
+                    profile = q;
+            }
+            if (profile < 0)
+            {
+                printf("Unknown quirks %s (vip, chip48, schip, xochip)\n", argv[i]);
+                return false;
+            }
+        }
+    }
+    config->quirk_profile = profile < 0 ? default_quirk_profiles[config->current_extension] : (quirk_profile_t)profile;
+    config->quirks = quirk_profiles[config->quirk_profile];
+
+    // Room for high resolution, at the same window size
+    if (config->current_extension != EXT_CHIP8)
+    {
+        config->window_width = HIRES_WIDTH;
+        config->window_height = HIRES_HEIGHT;
+        config->scale_factor = 10;
+    }
+
+    if (config->instructions_per_second < 60)
+    {
+        printf("Instructions per second must be at least 60\n");
+        return false;
+    }
+    if (config->timing == TIMING_VIP && config->current_extension != EXT_CHIP8)
+    {
+        printf("VIP timing is the COSMAC VIP's, it runs CHIP-8 only\n");
+        return false;
+    }
+    return true;
+}
+
+#define TRAP_CODE 0x01  // Covered by a translated block
+#define TRAP_WATCH 0x02 // Watched by the debugger
+
+// Debugger watchpoints live in ram_traps next to the translated code, so RAM writes check
+// both at once. Called whenever ram_traps is cleared
+static void mark_watched(chip8_t *chip8)
+{
+    if (!chip8->debug)
+        return;
+    for (uint16_t a = 0; a < RAM_SIZE; a++)
+        chip8->ram_traps[a] |= chip8->debug->watched[a] ? TRAP_WATCH : 0;
+}
+
+// Drop everything predecoded or translated from RAM, for when RAM is replaced wholesale.
+// Only the icache slots decode filled are cleared, a few hundred for a typical ROM, so a
+// machine starts without touching the whole 96 KB cache (machines start zeroed)
+void invalidate_code(chip8_t *chip8)
+{
+    for (uint32_t w = 0; w < sizeof chip8->decoded / sizeof chip8->decoded[0]; w++)
+    {
+        for (uint64_t bits = chip8->decoded[w]; bits; bits &= bits - 1)
+            chip8->icache[w * 64 + __builtin_ctzll(bits)].handler = NULL;
+        chip8->decoded[w] = 0;
+    }
+    memset(chip8->block_len, 0, sizeof chip8->block_len);
+    memset(chip8->ram_traps, 0, sizeof chip8->ram_traps);
+    chip8->block_used = 0;
+    mark_watched(chip8);
+#ifdef JIT
+    jit_flush(chip8);
+#endif
+}
+
+static const uint8_t font[] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// SCHIP 8x10 digits (FX30). SCHIP has 0-9, the letters are XO-CHIP's
+static const uint8_t big_font[] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+// Initial RAM for a ROM, EXT_RAM_SIZE(extension) bytes: fonts at 0, program at the entry
+// point, zeros elsewhere. CHIP8 images have no big font, RAM below the program is as it was
+bool build_ram_image(uint8_t *image, extension_t extension, const uint8_t *rom_data, size_t rom_size, const char *rom_name)
+{
+    const size_t max_size = EXT_RAM_SIZE(extension) - ENTRY_POINT;
+    if (rom_size > max_size)
+    {
+        printf("Rom file %s is bigger than RAM !?. Max size: %zu, Rom size: %zu", rom_name, max_size, rom_size);
+        return false;
+    }
+
+    memset(image, 0, EXT_RAM_SIZE(extension));
+    memcpy(&image[0], font, sizeof(font)); // FONT STARTS AT 0x0
+    if (extension != EXT_CHIP8)
+        memcpy(&image[BIG_FONT], big_font, sizeof(big_font));
+    memcpy(&image[ENTRY_POINT], rom_data, rom_size);
+    return true;
+}
+
+// Set machine defaults once RAM holds its initial image. Everything but RAM is reset,
+// so a machine can be reused for another ROM without clearing it first
+static void reset_chip8(chip8_t *chip8, const config_t *config, char rom_name[])
+{
+    // Nothing is predecoded yet
+    invalidate_code(chip8);
+
+    chip8->extension = config->current_extension;
+    chip8->hires = false;
+    chip8->planes = 1;
+    memset(chip8->rpl, 0, sizeof chip8->rpl);
+    memset(chip8->pattern, 0xF0, sizeof chip8->pattern); // 500 Hz square wave at the default pitch
+    chip8->pitch = AUDIO_PITCH;
+    memset(chip8->display, 0, sizeof chip8->display);
+    memset(chip8->stack, 0, sizeof chip8->stack);
+    memset(chip8->V, 0, sizeof chip8->V);
+    memset(chip8->keypad, 0, sizeof chip8->keypad);
+    memset(&chip8->fault, 0, sizeof chip8->fault);
+    chip8->I = 0;
+    chip8->delay_timer = 0;
+    chip8->sound_timer = 0;
+
+    chip8->state = RUNNING;  // Default state machine
+    chip8->PC = ENTRY_POINT; // Where programs start being loaded in RAM
+    chip8->rom_name = rom_name;
+    chip8->stack_depth = 0;
+    chip8->wait_key = 0xFF;
+    chip8->dirty_rows = DISPLAY_ALL_ROWS; // Nothing has been presented yet
+    chip8->frame = 0;
+    chip8->frame_done = 0;
+    chip8->cycles = VIP_FRAME_CYCLES;
+    seed_chip8(chip8, 0);
+#ifdef PROFILE
+    memset(&chip8->profile, 0, sizeof chip8->profile);
+#endif
+}
+
+// Load font and ROM into RAM and set machine defaults, for the machine the config asks for
+bool init_chip8_from_memory(chip8_t *chip8, const config_t *config, const uint8_t *rom_data, size_t rom_size, char rom_name[])
+{
+    if (!build_ram_image(chip8->ram, config->current_extension, rom_data, rom_size, rom_name))
+        return false;
+    reset_chip8(chip8, config, rom_name);
+    return true;
+}
+
+// Start from a RAM image prepared by build_ram_image for the same extension, which many
+// machines can share: initialization is then a single copy into RAM
+void init_chip8_from_image(chip8_t *chip8, const config_t *config, const uint8_t *image, char rom_name[])
+{
+    memcpy(chip8->ram, image, EXT_RAM_SIZE(config->current_extension));
+    reset_chip8(chip8, config, rom_name);
+}
+
+// Each machine draws CXNN values from its own generator, so machines never share state
+// and a run is repeatable from its seed. Scrambled (splitmix64) so nearby seeds give
+// unrelated streams and the xorshift state is never zero
+void seed_chip8(chip8_t *chip8, uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    chip8->rng = z ? z : 1;
+}
+
+bool init_chip8(chip8_t *chip8, const config_t *config, char rom_name[])
+{
+    static uint8_t rom_data[XO_RAM_SIZE]; // 64 KB, off the stack
+
+    // Load ROM
+    FILE *rom = fopen(rom_name, "rb");
+    if (!rom)
+    {
+        printf("Could not open ROM FILE: %s\n", rom_name);
+        return false;
+    }
+
+    // Get ROM SIZE
+    fseek(rom, 0, SEEK_END);
+    const size_t rom_size = ftell(rom); // Moment C
+    rewind(rom);
+
+    if (rom_size > sizeof rom_data)
+    {
+        printf("Rom file %s is bigger than RAM !?. Max size: %zu, Rom size: %zu", rom_name, sizeof rom_data, rom_size);
+        fclose(rom);
+        return false;
+    }
+
+    if (rom_size > 0 && fread(rom_data, rom_size, 1, rom) != 1)
+    {
+        printf("Could not read rom file into CHIP8 RAM\n");
+        fclose(rom);
+        return false;
+    };
+    fclose(rom);
+
+    return init_chip8_from_memory(chip8, config, rom_data, rom_size, rom_name);
+}
+
+// Opcode handlers. PC already points at the next instruction when a handler runs.
+// Every handler only reads its operands from the predecoded instruction.
+
+#define JIT_THRESHOLD 16 // Block executions before it is compiled to native code
+
+static void flush_blocks(chip8_t *chip8);
+static void ram_trap(chip8_t *chip8, uint16_t address);
+
+// Guest memory access. Every RAM, stack and keypad access of a handler goes through these
+// helpers or checks with fault() first. Normal builds wrap RAM addresses at the end of the
+// machine's RAM, ignore a call past the stack depth or a return on an empty stack, and use
+// the low nibble of a key: fault() is constant false and every check compiles away.
+// CHECKED builds (make checked, make headless-checked) trap those accesses instead: the
+// machine halts on the instruction before any of its effects, state QUIT, with the first
+// fault recorded for the frontend to report. Handlers that can fault move PC, so in these
+// builds they all end blocks.
+#ifdef CHECKED
+static bool fault(chip8_t *chip8, const instruction_t *inst, fault_reason_t reason, uint32_t address)
+{
+    chip8->PC -= 2; // Parked on the instruction, like 00FD
+    chip8->state = QUIT;
+    if (!chip8->fault.reason)
+        chip8->fault = (fault_t){.reason = reason, .pc = chip8->PC & 0xFFF, .opcode = inst->opcode, .address = address};
+    return true;
+}
+#else
+static inline bool fault(chip8_t *chip8, const instruction_t *inst, fault_reason_t reason, uint32_t address)
+{
+    (void)chip8;
+    (void)inst;
+    (void)reason;
+    (void)address;
+    return false;
+}
+#endif
+
+// Whether len bytes from address are all inside the machine's RAM
+static inline bool in_ram(const chip8_t *chip8, uint32_t address, uint32_t len)
+{
+    return address + len <= EXT_RAM_SIZE(chip8->extension);
+}
+
+static inline uint8_t read_ram(const chip8_t *chip8, uint32_t address)
+{
+    return chip8->ram[address & (EXT_RAM_SIZE(chip8->extension) - 1)];
+}
+
+// Any RAM write must go through here so predecoded instructions stay in sync with RAM.
+// Addresses wrap at the end of the machine's RAM
+static inline void write_ram(chip8_t *chip8, uint16_t address, uint8_t value)
+{
+    address &= EXT_RAM_SIZE(chip8->extension) - 1;
+    chip8->ram[address] = value;
+    if (address >= RAM_SIZE)
+        return; // XO-CHIP data, no code runs up there
+    chip8->icache[address].handler = NULL;               // Instruction starting at this byte
+    chip8->icache[(address - 1) & 0xFFF].handler = NULL; // Instruction ending at this byte
+    if (chip8->ram_traps[address])
+        ram_trap(chip8, address);
+}
+
+// Fetch the opcode at PC
+static inline uint16_t fetch_opcode(const chip8_t *chip8, uint16_t pc)
+{
+    return (chip8->ram[pc] << 8) | chip8->ram[(pc + 1) & 0xFFF]; // little endian -> big endian
+}
+
+// Skip the next instruction. XO-CHIP skips F000 NNNN, its one 4 byte instruction, whole; its
+// skips decode to the _xo handlers, so the other machines' skips never look for it
+__attribute__((always_inline)) static inline void skip_next(chip8_t *chip8, const bool xo)
+{
+    if (xo && fetch_opcode(chip8, chip8->PC & 0xFFF) == 0xF000)
+        chip8->PC += 2;
+    chip8->PC += 2;
+}
+
+// A skip's handler for the other machines and for XO-CHIP, from its skip_ body
+#define SKIP_HANDLERS(name)                                                                    \
+    static void op_##name(chip8_t *chip8, const instruction_t *inst, const config_t *config)    \
+    {                                                                                          \
+        (void)config;                                                                          \
+        skip_##name(chip8, inst, false);                                                       \
+    }                                                                                          \
+    static void op_##name##_xo(chip8_t *chip8, const instruction_t *inst, const config_t *config) \
+    {                                                                                          \
+        (void)config;                                                                          \
+        skip_##name(chip8, inst, true);                                                        \
+    }
+
+// xorshift64* step of the machine's own generator, top byte of the scrambled output
+static inline uint8_t next_random(chip8_t *chip8)
+{
+    uint64_t x = chip8->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    chip8->rng = x;
+    return (x * 0x2545F4914F6CDD1DULL) >> 56;
+}
+
+static void op_nop(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0NNN (machine code routine) and invalid opcodes are ignored
+    (void)chip8;
+    (void)inst;
+    (void)config;
+}
+
+// Display handlers come in one variant per resolution, and per machine for draws: decode picks
+// the one for the current mode (see decode_instruction) and a mode switch drops everything
+// predecoded. The mode arguments of the functions below are constants in each variant, so
+// every mode compiles to its own loops and the 64x32 ones are no slower for the others.
+// Only selected planes are touched; machines without planes always have the first selected
+
+static inline void clear_display(chip8_t *chip8, const bool hires)
+{
+    const uint32_t words = hires ? DISPLAY_WORDS : 1;
+    const uint32_t height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes >> p & 1))
+            continue;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            for (uint32_t y = 0; y < height; y++)
+            {
+                chip8->dirty_rows |= (uint64_t)(chip8->display[p][w][y] != 0) << y; // Only rows that had pixels change
+                chip8->display[p][w][y] = 0;
+            }
+        }
+    }
+#ifdef PROFILE
+    chip8->profile.drew = true;
+#endif
+}
+
+static void op_00e0(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // Clear screen
+    (void)inst;
+    (void)config;
+    clear_display(chip8, false);
+}
+
+static void op_00e0_hires(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    clear_display(chip8, true);
+}
+
+// Move the selected planes down by n rows (up if n is negative), rows scrolled in are blank
+static inline void scroll_rows(chip8_t *chip8, int n, const bool hires)
+{
+    const int height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    const uint32_t words = hires ? DISPLAY_WORDS : 1;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes >> p & 1))
+            continue;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            uint64_t *rows = chip8->display[p][w];
+            if (n > 0)
+                memmove(&rows[n], &rows[0], (height - n) * sizeof rows[0]);
+            else
+                memmove(&rows[0], &rows[-n], (height + n) * sizeof rows[0]);
+            memset(n > 0 ? &rows[0] : &rows[height + n], 0, (n > 0 ? n : -n) * sizeof rows[0]);
+        }
+    }
+    chip8->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+// Move the selected planes 4 pixels right (left if not), pixels scrolled in are blank
+static inline void scroll_columns(chip8_t *chip8, bool right, const bool hires)
+{
+    const uint32_t height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes >> p & 1))
+            continue;
+        uint64_t (*words)[HIRES_HEIGHT] = chip8->display[p];
+        for (uint32_t y = 0; y < height; y++)
+        {
+            if (!hires)
+                words[0][y] = right ? words[0][y] >> 4 : words[0][y] << 4;
+            else if (right)
+            {
+                words[1][y] = words[1][y] >> 4 | words[0][y] << 60;
+                words[0][y] >>= 4;
+            }
+            else
+            {
+                words[0][y] = words[0][y] << 4 | words[1][y] >> 60;
+                words[1][y] <<= 4;
+            }
+        }
+    }
+    chip8->dirty_rows = DISPLAY_ALL_ROWS;
+}
+
+// 00CN: scroll down N rows (SCHIP). 00DN: scroll up N rows (XO-CHIP)
+static void op_00cn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    scroll_rows(chip8, inst->N, false);
+}
+
+static void op_00cn_hires(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    scroll_rows(chip8, inst->N, true);
+}
+
+static void op_00dn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    scroll_rows(chip8, -inst->N, false);
+}
+
+static void op_00dn_hires(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    scroll_rows(chip8, -inst->N, true);
+}
+
+// 00FB: scroll right 4 pixels, 00FC: scroll left 4 pixels (SCHIP)
+static void op_00fb(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    scroll_columns(chip8, true, false);
+}
+
+static void op_00fb_hires(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    scroll_columns(chip8, true, true);
+}
+
+static void op_00fc(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    scroll_columns(chip8, false, false);
+}
+
+static void op_00fc_hires(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    scroll_columns(chip8, false, true);
+}
+
+static void op_00fd(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 00FD: exit the interpreter (SCHIP). The machine halts here, the display stays up
+    (void)inst;
+    (void)config;
+    chip8->PC -= 2;
+}
+
+static void op_00fe(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 00FE: low resolution, 00FF: high resolution (SCHIP). Either clears the display, and the
+    // display handlers decoded for the old mode go with the rest of the predecoded code
+    (void)config;
+    chip8->hires = inst->opcode == 0x00FF;
+    memset(chip8->display, 0, sizeof chip8->display);
+    chip8->dirty_rows = DISPLAY_ALL_ROWS;
+    invalidate_code(chip8);
+}
+
+static void op_00ee(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // Returns from a subroutine. A return with nothing on the stack is ignored
+    (void)config;
+    if (chip8->stack_depth)
+        chip8->PC = chip8->stack[--chip8->stack_depth];
+    else
+        fault(chip8, inst, FAULT_STACK_UNDERFLOW, 0);
+}
+
+static void op_1nnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // goto NNN
+    (void)config;
+    chip8->PC = inst->NNN;
+}
+
+static void op_2nnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // Calls subroutine at NNN. Past the stack depth the return adress is lost
+    (void)config;
+    if (chip8->stack_depth < STACK_DEPTH)
+        chip8->stack[chip8->stack_depth++] = chip8->PC; // Push return adress
+    else if (fault(chip8, inst, FAULT_STACK_OVERFLOW, chip8->stack_depth))
+        return;
+    chip8->PC = inst->NNN; // Change program counter
+}
+
+static inline void skip_3xnn(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 3XNN -> skips the next instruction if VX = NN
+    if (chip8->V[inst->X] == inst->NN)
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(3xnn)
+
+static inline void skip_4xnn(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 4XNN -> if(Vx != NN) skip the next instruiction
+    if (chip8->V[inst->X] != inst->NN)
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(4xnn)
+
+static inline void skip_5xy0(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 5XY0 -> if VX == VY skip the next insturction
+    if (chip8->V[inst->X] == chip8->V[inst->Y])
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(5xy0)
+
+static void op_6xnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0x6XNN; V[X] <= NN
+    (void)config;
+    chip8->V[inst->X] = inst->NN;
+}
+
+static void op_7xnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0x7XNN. V[X] += NN
+    (void)config;
+    chip8->V[inst->X] += inst->NN;
+}
+
+// Operatii aritmetice. The result is written before VF so VF holds the flag when X = F
+
+static void op_8xy0(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    chip8->V[inst->X] = chip8->V[inst->Y];
+}
+
+static void op_8xy1(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    chip8->V[inst->X] |= chip8->V[inst->Y];
+}
+
+static void op_8xy1_vf_reset(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    op_8xy1(chip8, inst, config);
+    chip8->V[0xF] = 0;
+}
+
+static void op_8xy2(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    chip8->V[inst->X] &= chip8->V[inst->Y];
+}
+
+static void op_8xy2_vf_reset(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    op_8xy2(chip8, inst, config);
+    chip8->V[0xF] = 0;
+}
+
+static void op_8xy3(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    chip8->V[inst->X] ^= chip8->V[inst->Y];
+}
+
+static void op_8xy3_vf_reset(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    op_8xy3(chip8, inst, config);
+    chip8->V[0xF] = 0;
+}
+
+static void op_8xy4(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint16_t sum = chip8->V[inst->X] + chip8->V[inst->Y];
+    chip8->V[inst->X] = sum;
+    chip8->V[0xF] = sum > 255;
+}
+
+static void op_8xy5(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = chip8->V[inst->X] >= chip8->V[inst->Y];
+    chip8->V[inst->X] -= chip8->V[inst->Y];
+    chip8->V[0xF] = carry;
+}
+
+static void op_8xy6(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = chip8->V[inst->Y] & 1;
+    chip8->V[inst->X] = chip8->V[inst->Y] >> 1; // Set VX = VY result
+    chip8->V[0xF] = carry;
+}
+
+static void op_8xy6_vx(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = chip8->V[inst->X] & 1;
+    chip8->V[inst->X] >>= 1; // Shift quirk: VX in place, VY is ignored
+    chip8->V[0xF] = carry;
+}
+
+static void op_8xy7(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = chip8->V[inst->Y] >= chip8->V[inst->X];
+    chip8->V[inst->X] = chip8->V[inst->Y] - chip8->V[inst->X];
+    chip8->V[0xF] = carry;
+}
+
+static void op_8xye(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = (chip8->V[inst->Y] & 0x80) >> 7;
+    chip8->V[inst->X] = chip8->V[inst->Y] << 1;
+    chip8->V[0xF] = carry;
+}
+
+static void op_8xye_vx(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    const uint8_t carry = (chip8->V[inst->X] & 0x80) >> 7;
+    chip8->V[inst->X] <<= 1;
+    chip8->V[0xF] = carry;
+}
+
+static inline void skip_9xy0(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 9XY0 if(Vx != Vy) skip next instruction
+    if (chip8->V[inst->X] != chip8->V[inst->Y])
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(9xy0)
+
+static void op_annn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xANNN; I (index register) <= NNN
+    (void)config;
+    chip8->I = inst->NNN;
+}
+
+static void op_bnnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xBNNN: jump to adress NNN + V[0]
+    (void)config;
+    chip8->PC = inst->NNN + chip8->V[0];
+}
+
+static void op_bxnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xBXNN: jump quirk, jump to adress XNN + VX
+    (void)config;
+    chip8->PC = inst->NNN + chip8->V[inst->X];
+}
+
+static void op_cxnn(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xCXNN = VX = random byte & NN
+    (void)config;
+    chip8->V[inst->X] = next_random(chip8) & inst->NN;
+}
+
+// DXYN: draw an N row sprite at VX,VY from I, or with wide a 16x16 one (DXY0, two bytes per
+// row). Screen pixels are XOR'd with sprite bits, VF is set if any pixel was switched off.
+// A row of the display is one 64 bit word per 64 pixels (leftmost pixel in the top bit), so a
+// sprite row is shifted into place and XOR'd in one go, spilling into the next word in high
+// resolution. Sprites are clipped at the right and bottom edges, or with the wrap quirk wrap
+// around. On XO-CHIP a sprite is drawn once per selected plane, with each plane's rows after
+// the last. With VIP timing the draw also charges the vblank wait. Always inlined so each
+// handler below is compiled for its constant mode
+__attribute__((always_inline)) static inline void draw_sprite(chip8_t *chip8, const instruction_t *inst, const bool wide,
+                                                              const bool hires, const bool wrap, const bool xo,
+                                                              const bool vip)
+{
+    const uint32_t width = hires ? HIRES_WIDTH : DISPLAY_WIDTH;
+    const uint32_t height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    const uint16_t ram_mask = (xo ? XO_RAM_SIZE : RAM_SIZE) - 1;
+    const uint32_t X_coord = chip8->V[inst->X] % width;
+    const uint32_t Y_coord = chip8->V[inst->Y] % height;
+    const uint32_t word = X_coord / 64;
+    const uint32_t shift = X_coord % 64;
+    const uint32_t sprite_rows = wide ? 16 : inst->N;
+    const uint32_t rows = !wrap && Y_coord + sprite_rows > height ? height - Y_coord : sprite_rows; // Clip at bottom edge
+    const uint32_t sprite_bytes = sprite_rows * (wide ? 2 : 1) * (xo ? __builtin_popcount(chip8->planes) : 1);
+    if (!in_ram(chip8, chip8->I, sprite_bytes) && fault(chip8, inst, FAULT_RAM_READ, chip8->I))
+        return;
+    uint16_t address = chip8->I;
+    uint64_t collision = 0;
+    uint64_t dirty = 0;
+
+    for (uint32_t p = 0; p < (xo ? DISPLAY_PLANES : 1); p++)
+    {
+        if (xo && !(chip8->planes >> p & 1))
+            continue;
+        uint64_t (*plane)[HIRES_HEIGHT] = chip8->display[p];
+        for (uint32_t i = 0; i < rows; i++)
+        {
+            const uint32_t y = wrap ? (Y_coord + i) % height : Y_coord + i;
+            const uint64_t sprite = wide ? (uint64_t)(chip8->ram[(address + 2 * i) & ram_mask] << 8 |
+                                                      chip8->ram[(address + 2 * i + 1) & ram_mask]) << 48
+                                         : (uint64_t)chip8->ram[(address + i) & ram_mask] << 56;
+            const uint64_t sprite_row = sprite >> shift;
+            collision |= plane[word][y] & sprite_row;
+            plane[word][y] ^= sprite_row;
+            dirty |= (uint64_t)(sprite_row != 0) << y; // Empty sprite rows change nothing
+#ifdef PROFILE
+            chip8->profile.pixels += __builtin_popcountll(sprite_row);
+#endif
+
+            // Pixels past this word: into the next one, around to the left edge, or clipped
+            const uint64_t spill = shift ? sprite << (64 - shift) : 0;
+            if (spill && (wrap || word + 1 < width / 64))
+            {
+                const uint32_t next = (word + 1) % (width / 64);
+                collision |= plane[next][y] & spill;
+                plane[next][y] ^= spill;
+                dirty |= 1ULL << y;
+#ifdef PROFILE
+                chip8->profile.pixels += __builtin_popcountll(spill);
+#endif
+            }
+        }
+        address += sprite_rows * (wide ? 2 : 1);
+    }
+
+    chip8->V[0xF] = collision != 0;
+    chip8->dirty_rows |= dirty;
+    // VIP timing: the rest of the frame went waiting for the vertical blank, the rows are drawn in the next
+    if (vip)
+        chip8->cycles = -(int32_t)(rows * (VIP_DRAW_ROW_CYCLES + VIP_DRAW_SHIFT_CYCLES * (X_coord % 8)));
+#ifdef PROFILE
+    chip8->profile.draws++;
+    chip8->profile.drew = true;
+#endif
+}
+
+#define DRAW_HANDLER(name, wide, hires, wrap, xo, vip)                                 \
+    static void name(chip8_t *chip8, const instruction_t *inst, const config_t *config) \
+    {                                                                                   \
+        (void)config;                                                                   \
+        draw_sprite(chip8, inst, wide, hires, wrap, xo, vip);                           \
+    }
+
+// DXYN and SCHIP's 16x16 DXY0, in low and high resolution
+#define DRAW_HANDLERS(suffix, wrap, xo)                                   \
+    DRAW_HANDLER(op_dxyn##suffix, false, false, wrap, xo, false)          \
+    DRAW_HANDLER(op_dxyn_hires##suffix, false, true, wrap, xo, false)     \
+    DRAW_HANDLER(op_dxy0##suffix, true, false, wrap, xo, false)           \
+    DRAW_HANDLER(op_dxy0_hires##suffix, true, true, wrap, xo, false)
+
+DRAW_HANDLERS(, false, false)
+DRAW_HANDLERS(_wrap, true, false)
+DRAW_HANDLERS(_xo_clip, false, true)
+DRAW_HANDLERS(_xo, true, true)
+// VIP timing is CHIP-8 only: low resolution DXYN, clipped or wrapped
+DRAW_HANDLER(op_dxyn_vip, false, false, false, false, true)
+DRAW_HANDLER(op_dxyn_wrap_vip, false, false, true, false, true)
+
+// Draw handler by [XO-CHIP][wrap quirk][high resolution][16x16]
+static const opcode_handler_t draw_handlers[2][2][2][2] = {
+    {{{op_dxyn, op_dxy0}, {op_dxyn_hires, op_dxy0_hires}},
+     {{op_dxyn_wrap, op_dxy0_wrap}, {op_dxyn_hires_wrap, op_dxy0_hires_wrap}}},
+    {{{op_dxyn_xo_clip, op_dxy0_xo_clip}, {op_dxyn_hires_xo_clip, op_dxy0_hires_xo_clip}},
+     {{op_dxyn_xo, op_dxy0_xo}, {op_dxyn_hires_xo, op_dxy0_hires_xo}}},
+};
+
+// VIP timing draw handler by [wrap quirk]
+static const opcode_handler_t draw_vip_handlers[2] = {op_dxyn_vip, op_dxyn_wrap_vip};
+
+// Is h one of the n handlers in a table, for instructions with quirk or mode variants
+static bool is_one_of(opcode_handler_t h, const opcode_handler_t *handlers, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (h == handlers[i])
+            return true;
+    }
+    return false;
+}
+
+static bool is_draw(opcode_handler_t h)
+{
+    return is_one_of(h, &draw_handlers[0][0][0][0], sizeof draw_handlers / sizeof(opcode_handler_t)) ||
+           is_one_of(h, draw_vip_handlers, 2);
+}
+
+static inline void skip_ex9e(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 0xEX9E: Skip next instruction if key in VX is pressed. Only the low nibble of VX picks
+    // the key, as on the VIP
+    if (chip8->V[inst->X] > 0xF && fault(chip8, inst, FAULT_KEY, chip8->V[inst->X]))
+        return;
+    if (chip8->keypad[chip8->V[inst->X] & 0xF])
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(ex9e)
+
+static inline void skip_exa1(chip8_t *chip8, const instruction_t *inst, const bool xo)
+{
+    // 0xEXA1: Skip next instruction if key in VX is not pressed
+    if (chip8->V[inst->X] > 0xF && fault(chip8, inst, FAULT_KEY, chip8->V[inst->X]))
+        return;
+    if (!chip8->keypad[chip8->V[inst->X] & 0xF])
+        skip_next(chip8, xo);
+}
+SKIP_HANDLERS(exa1)
+
+// VIP timing variants of the skips, picked at decode: a taken skip costs the VIP a few more
+// cycles than one that falls through. VIP timing is CHIP-8 only, so a skip moves PC by 2
+static inline void skip_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config,
+                            opcode_handler_t skip)
+{
+    const uint16_t pc = chip8->PC;
+    skip(chip8, inst, config);
+    if (chip8->PC == pc + 2)
+        chip8->cycles -= VIP_SKIP_CYCLES;
+}
+
+static void op_3xnn_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_3xnn);
+}
+
+static void op_4xnn_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_4xnn);
+}
+
+static void op_5xy0_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_5xy0);
+}
+
+static void op_9xy0_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_9xy0);
+}
+
+static void op_ex9e_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_ex9e);
+}
+
+static void op_exa1_vip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    skip_vip(chip8, inst, config, op_exa1);
+}
+
+// Every skip handler, by [plain, XO-CHIP, VIP timing][3XNN 4XNN 5XY0 9XY0 EX9E EXA1]
+static const opcode_handler_t skip_handlers[3][6] = {
+    {op_3xnn, op_4xnn, op_5xy0, op_9xy0, op_ex9e, op_exa1},
+    {op_3xnn_xo, op_4xnn_xo, op_5xy0_xo, op_9xy0_xo, op_ex9e_xo, op_exa1_xo},
+    {op_3xnn_vip, op_4xnn_vip, op_5xy0_vip, op_9xy0_vip, op_ex9e_vip, op_exa1_vip},
+};
+
+static bool is_skip(opcode_handler_t h)
+{
+    return is_one_of(h, &skip_handlers[0][0], sizeof skip_handlers / sizeof(opcode_handler_t));
+}
+
+static void op_fx0a(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0x0FX0A : VX = get_key(); wait until a keypress and release, then store it in VX
+    (void)config;
+    for (uint8_t i = 0; chip8->wait_key == 0xFF && i < 16; i++)
+    {
+        if (chip8->keypad[i])
+        {
+            chip8->wait_key = i;
+            break;
+        }
+    }
+    if (chip8->wait_key == 0xFF)
+        chip8->PC -= 2; // waits until a keypress
+    else
+    {
+        if (chip8->keypad[chip8->wait_key])
+            chip8->PC -= 2; // waits until the key is released
+        else
+        {
+            chip8->V[inst->X] = chip8->wait_key; // VX = key
+            chip8->wait_key = 0xFF;              // reset to key not foundd
+        }
+    }
+}
+
+static void op_fx1e(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX1E: I += VX
+    (void)config;
+    chip8->I += chip8->V[inst->X];
+}
+
+static void op_fx07(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX07: VX = delay timer
+    (void)config;
+    chip8->V[inst->X] = chip8->delay_timer;
+}
+
+static void op_fx15(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX15: delay timer = VX
+    (void)config;
+    chip8->delay_timer = chip8->V[inst->X];
+}
+
+static void op_fx18(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX18: sound timer = VX
+    (void)config;
+    chip8->sound_timer = chip8->V[inst->X];
+}
+
+static void op_fx29(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX29: Set register I to sprite location in memory for character in VX (0x0-0xF)
+    (void)config;
+    chip8->I = chip8->V[inst->X] * 5;
+}
+
+static void op_fx33(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // stores the BCD representaiton of VX, I = hundrend's digit, I+1 = ten's digit, i+2 = one's digit
+    (void)config;
+    if (!in_ram(chip8, chip8->I, 3) && fault(chip8, inst, FAULT_RAM_WRITE, chip8->I))
+        return;
+    uint8_t bcd = chip8->V[inst->X];
+    write_ram(chip8, chip8->I + 2, bcd % 10);
+    bcd /= 10;
+    write_ram(chip8, chip8->I + 1, bcd % 10);
+    bcd /= 10;
+    write_ram(chip8, chip8->I, bcd);
+}
+
+// 0xFX55: registry dump from 0 to X, starting from adress I, then I moves on as the
+// load/store quirk says: past the last register, one short of it, or not at all
+__attribute__((always_inline)) static inline void store_registers(chip8_t *chip8, const instruction_t *inst,
+                                                                  const load_store_t load_store)
+{
+    if (!in_ram(chip8, chip8->I, inst->X + 1) && fault(chip8, inst, FAULT_RAM_WRITE, chip8->I))
+        return;
+    for (uint8_t i = 0; i <= inst->X; i++)
+        write_ram(chip8, chip8->I + i, chip8->V[i]);
+    if (load_store != LOAD_STORE_KEEP)
+        chip8->I += inst->X + (load_store == LOAD_STORE_INC_X1);
+}
+
+// 0xFX65: registry load from 0 to X, starting from adress I, same quirk
+__attribute__((always_inline)) static inline void load_registers(chip8_t *chip8, const instruction_t *inst,
+                                                                 const load_store_t load_store)
+{
+    if (!in_ram(chip8, chip8->I, inst->X + 1) && fault(chip8, inst, FAULT_RAM_READ, chip8->I))
+        return;
+    for (uint8_t i = 0; i <= inst->X; i++)
+        chip8->V[i] = read_ram(chip8, chip8->I + i);
+    if (load_store != LOAD_STORE_KEEP)
+        chip8->I += inst->X + (load_store == LOAD_STORE_INC_X1);
+}
+
+#define LOAD_STORE_HANDLER(name, body, load_store)                                      \
+    static void name(chip8_t *chip8, const instruction_t *inst, const config_t *config) \
+    {                                                                                   \
+        (void)config;                                                                   \
+        body(chip8, inst, load_store);                                                  \
+    }
+
+LOAD_STORE_HANDLER(op_fx55, store_registers, LOAD_STORE_INC_X1)
+LOAD_STORE_HANDLER(op_fx55_inc_x, store_registers, LOAD_STORE_INC_X)
+LOAD_STORE_HANDLER(op_fx55_keep_i, store_registers, LOAD_STORE_KEEP)
+LOAD_STORE_HANDLER(op_fx65, load_registers, LOAD_STORE_INC_X1)
+LOAD_STORE_HANDLER(op_fx65_inc_x, load_registers, LOAD_STORE_INC_X)
+LOAD_STORE_HANDLER(op_fx65_keep_i, load_registers, LOAD_STORE_KEEP)
+
+// Load/store handlers by [load_store_t]
+static const opcode_handler_t store_handlers[] = {op_fx55, op_fx55_inc_x, op_fx55_keep_i};
+static const opcode_handler_t load_handlers[] = {op_fx65, op_fx65_inc_x, op_fx65_keep_i};
+
+static void op_fx30(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX30: I = big (8x10) sprite of the digit in VX (SCHIP)
+    (void)config;
+    chip8->I = BIG_FONT + (chip8->V[inst->X] & 0xF) * 10;
+}
+
+static void op_fx75(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX75: save V0 to VX in the flag registers (XO-CHIP has sixteen)
+    (void)config;
+    memcpy(chip8->rpl, chip8->V, inst->X + 1);
+}
+
+static void op_fx75_schip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // SCHIP has eight flag registers
+    (void)config;
+    memcpy(chip8->rpl, chip8->V, (inst->X > 7 ? 7 : inst->X) + 1);
+}
+
+static void op_fx85(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX85: load V0 to VX from the flag registers
+    (void)config;
+    memcpy(chip8->V, chip8->rpl, inst->X + 1);
+}
+
+static void op_fx85_schip(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    memcpy(chip8->V, chip8->rpl, (inst->X > 7 ? 7 : inst->X) + 1);
+}
+
+static void op_5xy2(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0x5XY2: save VX to VY at I, counting down if X > Y; I is left unmodified (XO-CHIP)
+    (void)config;
+    const int step = inst->X <= inst->Y ? 1 : -1;
+    if (!in_ram(chip8, chip8->I, abs(inst->X - inst->Y) + 1) && fault(chip8, inst, FAULT_RAM_WRITE, chip8->I))
+        return;
+    for (int i = 0, r = inst->X;; i++, r += step)
+    {
+        write_ram(chip8, chip8->I + i, chip8->V[r]);
+        if (r == inst->Y)
+            break;
+    }
+}
+
+static void op_5xy3(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0x5XY3: load VX to VY from I, counting down if X > Y; I is left unmodified (XO-CHIP)
+    (void)config;
+    const int step = inst->X <= inst->Y ? 1 : -1;
+    if (!in_ram(chip8, chip8->I, abs(inst->X - inst->Y) + 1) && fault(chip8, inst, FAULT_RAM_READ, chip8->I))
+        return;
+    for (int i = 0, r = inst->X;; i++, r += step)
+    {
+        chip8->V[r] = read_ram(chip8, chip8->I + i);
+        if (r == inst->Y)
+            break;
+    }
+}
+
+static void op_f000(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xF000 NNNN: I = NNNN, the word after the opcode (XO-CHIP). Read when it runs, so the
+    // operand needs nothing of its own in the decoded code
+    (void)config;
+    if (chip8->PC > 0xFFE && fault(chip8, inst, FAULT_FETCH, chip8->PC))
+        return;
+    chip8->I = fetch_opcode(chip8, chip8->PC & 0xFFF);
+    chip8->PC += 2;
+}
+
+static void op_fn01(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFN01: select the planes drawing, clearing and scrolling apply to, N = mask (XO-CHIP)
+    (void)config;
+    chip8->planes = inst->X & 0x3;
+}
+
+static void op_f002(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xF002: load the 16 byte sound pattern from I (XO-CHIP)
+    (void)config;
+    if (!in_ram(chip8, chip8->I, AUDIO_PATTERN) && fault(chip8, inst, FAULT_RAM_READ, chip8->I))
+        return;
+    for (uint16_t i = 0; i < AUDIO_PATTERN; i++)
+        chip8->pattern[i] = read_ram(chip8, chip8->I + i);
+}
+
+static void op_fx3a(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    // 0xFX3A: sound pattern pitch = VX (XO-CHIP)
+    (void)config;
+    chip8->pitch = chip8->V[inst->X];
+}
+
+// VIP cycles of an instruction, less what the handler charges at run time
+static uint16_t vip_cycles(const instruction_t *inst)
+{
+    uint16_t cycles;
+    switch (inst->opcode >> 12)
+    {
+    case 0x0: cycles = inst->opcode == 0x00E0 ? 3078 : 10; break; // 00E0 clears 256 bytes one at a time
+    case 0x1: cycles = 12; break;
+    case 0x2: cycles = 26; break;
+    case 0x3:
+    case 0x4: cycles = 10; break;
+    case 0x5:
+    case 0x9: cycles = 14; break;
+    case 0x6: cycles = 6; break;
+    case 0x7: cycles = 10; break;
+    case 0x8: cycles = 44; break; // Runs the ALU op from a subroutine built in RAM
+    case 0xA: cycles = 12; break;
+    case 0xB: cycles = 22; break;
+    case 0xC: cycles = 36; break;
+    case 0xD: cycles = 26; break; // Sprite setup, the rows are charged by the handler
+    case 0xE: cycles = 18; break;
+    default:
+        switch (inst->NN)
+        {
+        case 0x1E:
+        case 0x29: cycles = 16; break;
+        case 0x33: cycles = 164; break; // BCD by repeated subtraction, a typical value
+        case 0x55:
+        case 0x65: cycles = 14 + 14 * (inst->X + 1); break;
+        default: cycles = 10; break;
+        }
+        break;
+    }
+    return VIP_FETCH_CYCLES + cycles;
+}
+
+// Split an opcode into its operands and pick its handler, for the machine and quirks the
+// config asks for and the chip8's current display mode. Quirks are settled here, once per
+// decode, so the handlers the engines run have none left to test
+void decode_instruction(const chip8_t *chip8, const config_t *config, uint16_t opcode, instruction_t *inst)
+{
+    const bool schip = config->current_extension != EXT_CHIP8; // XO-CHIP has the SCHIP opcodes too
+    const bool xo = config->current_extension == EXT_XOCHIP;
+    const bool hires = chip8->hires;
+    const quirks_t *quirks = &config->quirks;
+    const bool vip = config->timing == TIMING_VIP;
+    const opcode_handler_t *skips = skip_handlers[vip ? 2 : xo]; // VIP timing is CHIP-8 only
+
+    inst->opcode = opcode;
+    inst->NNN = opcode & 0x0FFF;
+    inst->NN = opcode & 0x00FF;
+    inst->N = opcode & 0x000F;
+    inst->X = (opcode >> 8) & 0x0F;
+    inst->Y = (opcode >> 4) & 0x0F;
+    inst->handler = op_nop;
+
+    switch ((opcode >> 12) & 0x0F) // First 4 bits of the opcode
+    {
+    case 0x00:
+        if (opcode == 0x00E0)
+            inst->handler = hires ? op_00e0_hires : op_00e0;
+        else if (opcode == 0x00EE)
+            inst->handler = op_00ee;
+        else if (schip && (opcode & 0xFFF0) == 0x00C0)
+            inst->handler = hires ? op_00cn_hires : op_00cn;
+        else if (xo && (opcode & 0xFFF0) == 0x00D0)
+            inst->handler = hires ? op_00dn_hires : op_00dn;
+        else if (schip && opcode == 0x00FB)
+            inst->handler = hires ? op_00fb_hires : op_00fb;
+        else if (schip && opcode == 0x00FC)
+            inst->handler = hires ? op_00fc_hires : op_00fc;
+        else if (schip && opcode == 0x00FD)
+            inst->handler = op_00fd;
+        else if (schip && (opcode == 0x00FE || opcode == 0x00FF))
+            inst->handler = op_00fe;
+        break;
+    case 0x01: inst->handler = op_1nnn; break;
+    case 0x02: inst->handler = op_2nnn; break;
+    case 0x03: inst->handler = skips[0]; break;
+    case 0x04: inst->handler = skips[1]; break;
+    case 0x05:
+        if (inst->N == 0)
+            inst->handler = skips[2];
+        else if (xo && inst->N == 2)
+            inst->handler = op_5xy2;
+        else if (xo && inst->N == 3)
+            inst->handler = op_5xy3;
+        break;
+    case 0x06: inst->handler = op_6xnn; break;
+    case 0x07: inst->handler = op_7xnn; break;
+    case 0x08:
+        switch (inst->N)
+        {
+        case 0x0: inst->handler = op_8xy0; break;
+        case 0x1: inst->handler = quirks->vf_reset ? op_8xy1_vf_reset : op_8xy1; break;
+        case 0x2: inst->handler = quirks->vf_reset ? op_8xy2_vf_reset : op_8xy2; break;
+        case 0x3: inst->handler = quirks->vf_reset ? op_8xy3_vf_reset : op_8xy3; break;
+        case 0x4: inst->handler = op_8xy4; break;
+        case 0x5: inst->handler = op_8xy5; break;
+        case 0x6: inst->handler = quirks->shift_vx ? op_8xy6_vx : op_8xy6; break;
+        case 0x7: inst->handler = op_8xy7; break;
+        case 0xE: inst->handler = quirks->shift_vx ? op_8xye_vx : op_8xye; break;
+        default: break;
+        }
+        break;
+    case 0x09: inst->handler = skips[3]; break;
+    case 0x0A: inst->handler = op_annn; break;
+    case 0x0B: inst->handler = quirks->jump_vx ? op_bxnn : op_bnnn; break;
+    case 0x0C: inst->handler = op_cxnn; break;
+    case 0x0D:
+        inst->handler = vip ? draw_vip_handlers[quirks->wrap] : draw_handlers[xo][quirks->wrap][hires][schip && inst->N == 0];
+        break;
+    case 0x0E:
+        if (inst->NN == 0x9E)
+            inst->handler = skips[4];
+        else if (inst->NN == 0xA1)
+            inst->handler = skips[5];
+        break;
+    case 0x0F:
+        switch (inst->NN)
+        {
+        case 0x0A: inst->handler = op_fx0a; break;
+        case 0x1E: inst->handler = op_fx1e; break;
+        case 0x07: inst->handler = op_fx07; break;
+        case 0x15: inst->handler = op_fx15; break;
+        case 0x18: inst->handler = op_fx18; break;
+        case 0x29: inst->handler = op_fx29; break;
+        case 0x33: inst->handler = op_fx33; break;
+        case 0x55: inst->handler = store_handlers[quirks->load_store]; break;
+        case 0x65: inst->handler = load_handlers[quirks->load_store]; break;
+        case 0x30: inst->handler = schip ? op_fx30 : op_nop; break;
+        case 0x75: inst->handler = xo ? op_fx75 : schip ? op_fx75_schip : op_nop; break;
+        case 0x85: inst->handler = xo ? op_fx85 : schip ? op_fx85_schip : op_nop; break;
+        case 0x00: inst->handler = xo && opcode == 0xF000 ? op_f000 : op_nop; break;
+        case 0x01: inst->handler = xo ? op_fn01 : op_nop; break;
+        case 0x02: inst->handler = xo && opcode == 0xF002 ? op_f002 : op_nop; break;
+        case 0x3A: inst->handler = xo ? op_fx3a : op_nop; break;
+        default: break;
+        }
+        break;
+    }
+    inst->cycles = vip ? vip_cycles(inst) : 0;
+}
+
+// Debugger traps. An armed address decodes to a trap handler instead of its instruction,
+// so the engines pay nothing for breakpoints: the check happens once per decode, which only
+// the reference engine does per step. A stop leaves the machine PAUSED; the engines keep
+// dispatching to the end of their budget, parked on a breakpoint handler at PC, and the
+// frame resumes from there (see emulate_frame)
+
+void debug_stop(chip8_t *chip8, debug_reason_t reason, uint16_t address)
+{
+    debugger_t *debug = chip8->debug;
+    debug->stopped = true;
+    debug->reason = reason;
+    debug->address = address;
+    chip8->state = PAUSED;
+}
+
+// Watchpoints stop after the instruction that hit them, by parking on the next one
+static void stop_after(chip8_t *chip8, debug_reason_t reason, uint16_t address)
+{
+    debugger_t *debug = chip8->debug;
+    const bool running = !debug->stopped; // Stepping parks nothing
+    debug_stop(chip8, reason, address);
+    if (!running)
+        return;
+    debug->stop_pending = true;
+    debug->stop_pc = chip8->PC & 0xFFF;
+    chip8->icache[debug->stop_pc].handler = NULL; // Redecoded as a trap
+    flush_blocks(chip8);
+}
+
+// Breakpoint: undo the fetch and park on this instruction, it has not run
+static void op_break(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)inst;
+    (void)config;
+    chip8->PC -= 2;
+    chip8->debug->parked++;
+    chip8->debug->parked_cycles += inst->cycles;
+    if (!chip8->debug->stopped)
+        debug_stop(chip8, DEBUG_BREAKPOINT, chip8->PC & 0xFFF);
+}
+
+// An instruction that may write I, while I is watched
+static void op_watch_i(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    instruction_t real; // The handler may write RAM, dropping the cached instruction
+    decode_instruction(chip8, config, inst->opcode, &real);
+    const uint16_t I = chip8->I;
+    real.handler(chip8, &real, config);
+    if (chip8->I != I)
+    {
+        chip8->debug->old_I = I;
+        stop_after(chip8, DEBUG_WATCH_I, 0);
+    }
+}
+
+#ifdef CHECKED
+// An instruction at 0xFFF, whose second byte would wrap around to 0
+static void op_fault_fetch(chip8_t *chip8, const instruction_t *inst, const config_t *config)
+{
+    (void)config;
+    fault(chip8, inst, FAULT_FETCH, 0xFFF);
+}
+#endif
+
+// Decode the instruction at pc, the opcode straddling the end of RAM as a fetch fault
+static inline void decode_fetched(const chip8_t *chip8, const config_t *config, uint16_t pc, instruction_t *inst)
+{
+    decode_instruction(chip8, config, fetch_opcode(chip8, pc), inst);
+#ifdef CHECKED
+    if (pc == 0xFFF)
+        inst->handler = op_fault_fetch;
+#endif
+}
+
+// Decode the instruction at pc for the engines, as a trap if the debugger has it armed
+static inline void decode_at(const chip8_t *chip8, const config_t *config, uint16_t pc, instruction_t *inst)
+{
+    decode_fetched(chip8, config, pc, inst);
+    const debugger_t *debug = chip8->debug;
+    if (!debug)
+        return;
+
+    const opcode_handler_t h = inst->handler;
+    if (debug->breakpoints[pc] || (debug->stop_pending && pc == debug->stop_pc))
+        inst->handler = op_break;
+    else if (debug->watch_i && (h == op_annn || h == op_fx1e || h == op_fx29 || is_one_of(h, store_handlers, 3) || is_one_of(h, load_handlers, 3) ||
+                                h == op_fx30 || h == op_f000))
+        inst->handler = op_watch_i;
+}
+
+// Predecoded instruction at pc, decoded into the icache on first use
+static inline instruction_t *cached_at(chip8_t *chip8, const config_t *config, uint16_t pc)
+{
+    instruction_t *inst = &chip8->icache[pc];
+    if (!inst->handler)
+    {
+        decode_at(chip8, config, pc, inst);
+        chip8->decoded[pc / 64] |= 1ull << (pc % 64);
+    }
+    return inst;
+}
+
+#ifdef PROFILE
+// Host clock for the profile: the time stamp counter where the CPU has one
+static inline uint64_t profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void profile_instruction(chip8_t *chip8, uint16_t pc, uint16_t opcode, uint64_t cycles)
+{
+    profile_t *profile = &chip8->profile;
+    profile->family[opcode >> 12].count++;
+    profile->family[opcode >> 12].cycles += cycles;
+    profile->pc[pc].count++;
+    profile->pc[pc].cycles += cycles;
+    profile->opcode[pc] = opcode;
+}
+
+// Count the instructions of a block. Done before the block runs, its terminator may write RAM
+// and drop the decoded instructions
+static void profile_block(chip8_t *chip8, const block_entry_t *code, uint8_t entries)
+{
+    for (uint8_t i = 0; i < entries; i++)
+        profile_instruction(chip8, code[i].pc, chip8->icache[code[i].pc].opcode, 0);
+}
+
+// A skip in a block passed over this instruction, it did not run after all
+static void profile_skipped(chip8_t *chip8, uint16_t pc)
+{
+    profile_t *profile = &chip8->profile;
+    profile->family[profile->opcode[pc] >> 12].count--;
+    profile->pc[pc].count--;
+}
+
+// Once it ran, share the ticks the block took equally between its instructions
+static void profile_block_cycles(chip8_t *chip8, const block_entry_t *code, uint8_t entries, uint64_t cycles)
+{
+    profile_t *profile = &chip8->profile;
+    for (uint8_t i = 0; i < entries; i++)
+    {
+        const uint16_t a = code[i].pc;
+        const uint64_t share = cycles / entries + (i + 1 == entries ? cycles % entries : 0);
+        profile->family[profile->opcode[a] >> 12].cycles += share;
+        profile->pc[a].cycles += share;
+    }
+}
+#endif
+
+// Reference path: fetch and decode on every step. The single step paths return the VIP
+// cycles of the instruction they ran, which flat timing ignores
+static uint16_t emulate_instruction_decode(chip8_t *chip8, const config_t *config)
+{
+    instruction_t inst;
+    const uint16_t pc = chip8->PC & 0xFFF;
+    decode_at(chip8, config, pc, &inst);
+    chip8->PC += 2;
+
+#ifdef PROFILE
+    const uint64_t start = profile_clock();
+    inst.handler(chip8, &inst, config);
+    profile_instruction(chip8, pc, inst.opcode, profile_clock() - start);
+#else
+    inst.handler(chip8, &inst, config);
+#endif
+    return inst.cycles;
+}
+
+// Cached path: decode each RAM slot once, writes to RAM drop the slots they touch
+static inline uint16_t emulate_instruction_cached(chip8_t *chip8, const config_t *config)
+{
+    const uint16_t pc = chip8->PC & 0xFFF;
+    instruction_t *inst = cached_at(chip8, config, pc);
+    chip8->PC += 2;
+    const uint16_t cycles = inst->cycles; // The handler may drop the cached instruction
+
+#ifdef PROFILE
+    const uint16_t opcode = inst->opcode;
+    const uint64_t start = profile_clock();
+    inst->handler(chip8, inst, config);
+    profile_instruction(chip8, pc, opcode, profile_clock() - start);
+#else
+    inst->handler(chip8, inst, config);
+#endif
+    return cycles;
+}
+
+// Basic-block engine (threaded code).
+// A block is a run of instructions from an entry address up to and including the first
+// instruction that changes control flow in a way only known at run time (return, computed
+// jump, key wait), draws, or writes RAM. Translation follows the control flow it can see:
+// a 1NNN or 2NNN goes on at NNN, and a skip over a plain instruction stays in the block and
+// passes over that instruction when taken. Each block is its own list of entries, so the
+// same instruction may be translated into several blocks. The block is executed as a chain
+// of inline ops and handler calls with no fetch, decode or PC update in between, and always
+// runs whole: the frame it ends in is charged for all of it, the next frame is that much
+// shorter (see emulate_frame).
+
+// Does this instruction end a block
+static bool ends_block(const instruction_t *inst)
+{
+    const opcode_handler_t h = inst->handler;
+#ifdef CHECKED
+    if (is_one_of(h, load_handlers, 3) || h == op_5xy3 || h == op_f002 || h == op_fault_fetch)
+        return true; // Can fault, which moves PC
+#endif
+    return h == op_00ee || h == op_1nnn || h == op_2nnn || h == op_bnnn || h == op_bxnn ||
+           is_skip(h) || is_draw(h) || h == op_fx0a ||
+           h == op_fx33 || is_one_of(h, store_handlers, 3) || h == op_break || h == op_watch_i ||
+           h == op_00fd || h == op_00fe || h == op_5xy2 || h == op_f000;
+}
+
+// Inline op for an instruction, and its flag-free variant (BOP_HANDLER if it has none)
+static block_op_t block_op(const instruction_t *inst, block_op_t *flag_free)
+{
+    const opcode_handler_t h = inst->handler;
+
+    // VF is dead wherever a flag-free variant is used, so it may also be the destination
+    *flag_free = BOP_HANDLER;
+    if (h == op_6xnn) return BOP_6XNN;
+    if (h == op_7xnn) return BOP_7XNN;
+    if (h == op_8xy0) return BOP_8XY0;
+    if (h == op_annn) return BOP_ANNN;
+    if (h == op_fx1e) return BOP_FX1E;
+    if (h == op_8xy1) return BOP_8XY1_NF;
+    if (h == op_8xy2) return BOP_8XY2_NF;
+    if (h == op_8xy3) return BOP_8XY3_NF;
+    if (h == op_8xy1_vf_reset) { *flag_free = BOP_8XY1_NF; return BOP_8XY1; }
+    if (h == op_8xy2_vf_reset) { *flag_free = BOP_8XY2_NF; return BOP_8XY2; }
+    if (h == op_8xy3_vf_reset) { *flag_free = BOP_8XY3_NF; return BOP_8XY3; }
+    if (h == op_8xy4) { *flag_free = BOP_8XY4_NF; return BOP_8XY4; }
+    if (h == op_8xy5) { *flag_free = BOP_8XY5_NF; return BOP_8XY5; }
+    if (h == op_8xy7) { *flag_free = BOP_8XY7_NF; return BOP_8XY7; }
+    return BOP_HANDLER;
+}
+
+// Inline op for a skip kept inside a block, BOP_HANDLER if it has to end the block. VIP
+// timing skips charge what they take, and EX9E/EXA1 can fault in a CHECKED build
+static block_op_t skip_op(const instruction_t *inst)
+{
+    const opcode_handler_t h = inst->handler;
+    if (h == op_3xnn || h == op_3xnn_xo) return BOP_SKIP_EQ;
+    if (h == op_4xnn || h == op_4xnn_xo) return BOP_SKIP_NE;
+    if (h == op_5xy0 || h == op_5xy0_xo) return BOP_SKIP_EQ_V;
+    if (h == op_9xy0 || h == op_9xy0_xo) return BOP_SKIP_NE_V;
+#ifndef CHECKED
+    if (h == op_ex9e || h == op_ex9e_xo) return BOP_SKIP_KEY;
+    if (h == op_exa1 || h == op_exa1_xo) return BOP_SKIP_NO_KEY;
+#endif
+    return BOP_HANDLER;
+}
+
+static bool is_skip_op(block_op_t op)
+{
+    return op >= BOP_SKIP_EQ && op <= BOP_SKIP_NO_KEY;
+}
+
+// Writes VF unconditionally without reading it (flag ops, VF reset quirk, 6FNN)
+static bool kills_vf(const instruction_t *inst)
+{
+    const opcode_handler_t h = inst->handler;
+    if (h == op_8xy4 || h == op_8xy5 || h == op_8xy6 || h == op_8xy7 || h == op_8xye ||
+        h == op_8xy6_vx || h == op_8xye_vx)
+        return true;
+    if (h == op_8xy1_vf_reset || h == op_8xy2_vf_reset || h == op_8xy3_vf_reset)
+        return true;
+    return h == op_6xnn && inst->X == 0xF;
+}
+
+// Conservative: any instruction naming VF as an operand may read it
+static bool reads_vf(const instruction_t *inst)
+{
+    const opcode_handler_t h = inst->handler;
+    if (h == op_nop || h == op_00e0 || h == op_00ee || h == op_1nnn || h == op_2nnn ||
+        h == op_annn || h == op_bnnn)
+        return false;
+    return inst->X == 0xF || inst->Y == 0xF;
+}
+
+// Drop every translated block, called when RAM under a block is written
+static void flush_blocks(chip8_t *chip8)
+{
+    memset(chip8->block_len, 0, sizeof chip8->block_len);
+    memset(chip8->ram_traps, 0, sizeof chip8->ram_traps);
+    chip8->block_used = 0;
+    mark_watched(chip8);
+#ifdef JIT
+    jit_flush(chip8);
+#endif
+}
+
+// Slow path of write_ram, for bytes under translated code or watched by the debugger
+static void ram_trap(chip8_t *chip8, uint16_t address)
+{
+    const uint8_t traps = chip8->ram_traps[address];
+    if (traps & TRAP_CODE)
+        flush_blocks(chip8);
+    if (traps & TRAP_WATCH)
+        stop_after(chip8, DEBUG_WATCH_RAM, address);
+}
+
+// Decoded instruction at addr for a block being translated; writes to it now drop the blocks
+static const instruction_t *decode_for_block(chip8_t *chip8, const config_t *config, uint16_t addr)
+{
+    const instruction_t *inst = cached_at(chip8, config, addr);
+    chip8->ram_traps[addr] |= TRAP_CODE;
+    chip8->ram_traps[(addr + 1) & 0xFFF] |= TRAP_CODE;
+    return inst;
+}
+
+// Can translation go on at target: in RAM, and not back into the block (a loop ends it)
+static bool can_follow(const block_entry_t *code, uint16_t entries, uint16_t target)
+{
+    if (target > 0xFFE)
+        return false;
+    for (uint16_t i = 0; i < entries; i++)
+    {
+        if (code[i].pc == target)
+            return false;
+    }
+    return true;
+}
+
+// Translate the block starting at pc, returns the instructions it runs when no skip is taken
+static uint16_t translate_block(chip8_t *chip8, uint16_t pc, const config_t *config)
+{
+    if (chip8->block_used + BLOCK_MAX > BLOCK_CODE)
+        flush_blocks(chip8); // Out of entries: start over, blocks in use get translated again
+    block_entry_t *code = &chip8->block_code[chip8->block_used];
+
+    // VIP timing charges a block before it runs, so what it costs may not depend on its skips.
+    // Calls can fault in a CHECKED build
+    const bool inline_skips = config->timing != TIMING_VIP;
+#ifdef CHECKED
+    const bool follow_calls = false;
+#else
+    const bool follow_calls = true;
+#endif
+
+    // Forward: decode up to the terminator, following jumps, calls and skips
+    uint16_t entries = 0;
+    uint16_t len = 0;
+    uint32_t cycles = 0;
+    uint16_t addr = pc;
+    for (;;)
+    {
+        const instruction_t *inst = decode_for_block(chip8, config, addr);
+        const opcode_handler_t h = inst->handler;
+        block_entry_t *entry = &code[entries++];
+        *entry = (block_entry_t){
+            .op = BOP_TERMINATOR, .X = inst->X, .Y = inst->Y, .NN = inst->NN, .NNN = inst->NNN, .pc = addr,
+        };
+        len++;
+        if (len == BLOCK_MAX || addr + 2 > 0xFFE)
+            break;
+
+        if ((h == op_1nnn || (h == op_2nnn && follow_calls)) &&
+            len + 1 < BLOCK_MAX && can_follow(code, entries, inst->NNN))
+        {
+            entry->op = h == op_2nnn ? BOP_CALL : BOP_JUMP;
+#ifndef PROFILE
+            if (h == op_1nnn)
+                entries--; // Nothing to run, only counted
+#endif
+            cycles += inst->cycles;
+            addr = inst->NNN;
+            continue;
+        }
+
+        // A skip stays in the block if what it skips is a plain instruction that does not end
+        // the block itself, so the entry after it is always the instruction after that
+        const block_op_t skip = inline_skips ? skip_op(inst) : BOP_HANDLER;
+        if (skip != BOP_HANDLER && len + 1 < BLOCK_MAX && addr + 4 <= 0xFFE &&
+            !ends_block(decode_for_block(chip8, config, addr + 2)))
+        {
+            entry->op = skip;
+            cycles += inst->cycles;
+            addr += 2;
+            continue;
+        }
+
+        if (ends_block(inst))
+            break;
+        entry->op = BOP_HANDLER; // Op chosen below, once it is known whether VF is live
+        cycles += inst->cycles;
+        addr += 2;
+    }
+
+    // Backward: VF is live after the terminator, drop flag writes that are overwritten unread.
+    // An instruction a skip may pass over kills nothing
+    bool vf_live = true;
+    for (uint16_t i = entries; i-- > 0;)
+    {
+        block_entry_t *entry = &code[i];
+        const instruction_t *inst = &chip8->icache[entry->pc];
+        if (entry->op == BOP_HANDLER)
+        {
+            block_op_t flag_free;
+            entry->op = block_op(inst, &flag_free);
+            if (flag_free != BOP_HANDLER && !vf_live)
+                entry->op = flag_free;
+        }
+
+        if (kills_vf(inst) && !(i > 0 && is_skip_op(code[i - 1].op)))
+            vf_live = reads_vf(inst); // VF is written here, only this instruction's reads matter
+        else
+            vf_live = vf_live || reads_vf(inst);
+    }
+
+    chip8->block_start[pc] = chip8->block_used;
+    chip8->block_entries[pc] = entries;
+    chip8->block_cycles[pc] = cycles;
+    chip8->block_len[pc] = len;
+    chip8->block_used += entries;
+    return len;
+}
+
+// A taken skip in a block passes over the entry after it
+static inline void skip_entry(chip8_t *chip8, const block_entry_t **entry, uint16_t *skipped)
+{
+    (*entry)++;
+    (*skipped)++;
+#ifdef PROFILE
+    profile_skipped(chip8, (*entry)->pc);
+#else
+    (void)chip8;
+#endif
+}
+
+// Run a block's entries inline up to and including its terminator, which returns. The only
+// branches per instruction are the op dispatch. Returns the entries taken skips passed over
+static inline uint16_t run_block_code(chip8_t *chip8, const config_t *config, const block_entry_t *e)
+{
+    uint8_t *V = chip8->V;
+    uint16_t skipped = 0;
+    for (;; e++)
+    {
+        uint16_t sum;
+        uint8_t carry;
+        switch ((block_op_t)e->op)
+        {
+        case BOP_6XNN: V[e->X] = e->NN; break;
+        case BOP_7XNN: V[e->X] += e->NN; break;
+        case BOP_8XY0: V[e->X] = V[e->Y]; break;
+        case BOP_8XY1: V[e->X] |= V[e->Y]; V[0xF] = 0; break;
+        case BOP_8XY2: V[e->X] &= V[e->Y]; V[0xF] = 0; break;
+        case BOP_8XY3: V[e->X] ^= V[e->Y]; V[0xF] = 0; break;
+        case BOP_8XY4:
+            sum = V[e->X] + V[e->Y];
+            V[e->X] = sum;
+            V[0xF] = sum > 255;
+            break;
+        case BOP_8XY5:
+            carry = V[e->X] >= V[e->Y];
+            V[e->X] -= V[e->Y];
+            V[0xF] = carry;
+            break;
+        case BOP_8XY7:
+            carry = V[e->Y] >= V[e->X];
+            V[e->X] = V[e->Y] - V[e->X];
+            V[0xF] = carry;
+            break;
+        case BOP_ANNN: chip8->I = e->NNN; break;
+        case BOP_FX1E: chip8->I += V[e->X]; break;
+        case BOP_8XY1_NF: V[e->X] |= V[e->Y]; break;
+        case BOP_8XY2_NF: V[e->X] &= V[e->Y]; break;
+        case BOP_8XY3_NF: V[e->X] ^= V[e->Y]; break;
+        case BOP_8XY4_NF: V[e->X] += V[e->Y]; break;
+        case BOP_8XY5_NF: V[e->X] -= V[e->Y]; break;
+        case BOP_8XY7_NF: V[e->X] = V[e->Y] - V[e->X]; break;
+        case BOP_SKIP_EQ:
+            if (V[e->X] == e->NN)
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_SKIP_NE:
+            if (V[e->X] != e->NN)
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_SKIP_EQ_V:
+            if (V[e->X] == V[e->Y])
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_SKIP_NE_V:
+            if (V[e->X] != V[e->Y])
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_SKIP_KEY:
+            if (chip8->keypad[V[e->X] & 0xF])
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_SKIP_NO_KEY:
+            if (!chip8->keypad[V[e->X] & 0xF])
+                skip_entry(chip8, &e, &skipped);
+            break;
+        case BOP_CALL:
+            // As 2NNN: past the stack depth the return adress is lost
+            if (chip8->stack_depth < STACK_DEPTH)
+                chip8->stack[chip8->stack_depth++] = e->pc + 2;
+            break;
+        case BOP_JUMP: break;
+        case BOP_TERMINATOR:
+            // The terminator sees PC pointing past it, as in the single step engines
+            chip8->PC = e->pc + 2;
+            chip8->icache[e->pc].handler(chip8, &chip8->icache[e->pc], config);
+            return skipped;
+        case BOP_HANDLER:
+        default:
+            chip8->icache[e->pc].handler(chip8, &chip8->icache[e->pc], config);
+            break;
+        }
+    }
+}
+
+// Run the whole block starting at PC, as native code when use_jit is set and the block is hot.
+// Returns the number of instructions executed
+static inline uint16_t run_block(chip8_t *chip8, const config_t *config, uint16_t pc, const bool use_jit)
+{
+    const block_entry_t *code = &chip8->block_code[chip8->block_start[pc]];
+    const uint16_t len = chip8->block_len[pc];
+#ifdef PROFILE
+    const uint8_t entries = chip8->block_entries[pc];
+    profile_block(chip8, code, entries);
+    const uint64_t start = profile_clock();
+#endif
+
+    uint16_t skipped;
+#ifdef JIT
+    jit_t *jit = &chip8->jit;
+    if (use_jit && !jit->code[pc] && jit->hits[pc] < 255 && ++jit->hits[pc] == JIT_THRESHOLD)
+        jit_compile(chip8, pc);
+    if (use_jit && jit->code[pc])
+        skipped = jit->code[pc](chip8, config);
+    else
+        skipped = run_block_code(chip8, config, code);
+#else
+    (void)use_jit;
+    skipped = run_block_code(chip8, config, code);
+#endif
+#ifdef PROFILE
+    profile_block_cycles(chip8, code, entries, profile_clock() - start);
+#endif
+    return len - skipped;
+}
+
+// Run whole blocks until at least count instructions ran, returns how many did
+static inline uint32_t emulate_blocks(chip8_t *chip8, const config_t *config, uint32_t count, const bool use_jit)
+{
+    uint32_t executed = 0;
+    while (executed < count)
+    {
+        const uint16_t pc = chip8->PC;
+        if (pc > 0xFFE)
+        {
+            emulate_instruction_cached(chip8, config);
+            executed++;
+            continue;
+        }
+
+        if (!chip8->block_len[pc])
+            translate_block(chip8, pc, config);
+        executed += run_block(chip8, config, pc, use_jit);
+    }
+    return executed;
+}
+
+// VIP timing: run whole blocks until the frame's cycles are spent, the last one overruns into
+// the next frame as any last instruction of a frame does. Returns the number of instructions
+// executed
+static inline uint32_t emulate_blocks_vip(chip8_t *chip8, const config_t *config, const bool use_jit)
+{
+    uint32_t executed = 0;
+    while (chip8->cycles > 0)
+    {
+        const uint16_t pc = chip8->PC;
+        if (pc > 0xFFE)
+        {
+            const uint16_t cycles = emulate_instruction_cached(chip8, config);
+            chip8->cycles -= cycles;
+            executed++;
+            continue;
+        }
+
+        if (!chip8->block_len[pc])
+            translate_block(chip8, pc, config);
+
+        // The terminator may write RAM and drop the decoded instructions, and a draw sets
+        // what is left, so the block is charged before it runs and the terminator after
+        const block_entry_t *last = &chip8->block_code[chip8->block_start[pc] + chip8->block_entries[pc] - 1];
+        const uint16_t last_cycles = chip8->icache[last->pc].cycles;
+        chip8->cycles -= chip8->block_cycles[pc];
+        executed += run_block(chip8, config, pc, use_jit);
+        chip8->cycles -= last_cycles;
+    }
+    return executed;
+}
+
+// Run exactly one block (a single instruction outside the block range) with the block or JIT
+// engine, returns the number of instructions executed. Used to compare engines block by block
+uint32_t emulate_block(chip8_t *chip8, const config_t *config)
+{
+    const uint16_t pc = chip8->PC;
+    if (pc > 0xFFE)
+    {
+        emulate_instruction_cached(chip8, config);
+        return 1;
+    }
+
+    if (!chip8->block_len[pc])
+        translate_block(chip8, pc, config);
+    return run_block(chip8, config, pc, config->engine == ENGINE_JIT);
+}
+
+// One trace record of what the instruction at pc left behind
+static void trace_instruction(chip8_t *chip8, uint16_t pc, uint16_t opcode)
+{
+    trace_t *trace = chip8->trace;
+    trace->entries[trace->steps++ & trace->mask] = (trace_entry_t){
+        .pc = pc,
+        .opcode = opcode,
+        .I = chip8->I,
+        .vx = chip8->V[(opcode >> 8) & 0xF],
+        .vf = chip8->V[0xF],
+    };
+}
+
+// Traced step: the single step engine, then a trace record.
+// The block engines step the cached way while a trace is on
+static uint16_t emulate_instruction_traced(chip8_t *chip8, const config_t *config)
+{
+    const uint16_t pc = chip8->PC & 0xFFF;
+    const uint16_t opcode = fetch_opcode(chip8, pc);
+    const uint16_t cycles = config->engine == ENGINE_DECODE ? emulate_instruction_decode(chip8, config)
+                                                            : emulate_instruction_cached(chip8, config);
+
+    if (chip8->debug && chip8->debug->stopped && chip8->PC == pc)
+        return cycles; // Parked on a stop, nothing ran
+    trace_instruction(chip8, pc, opcode);
+    return cycles;
+}
+
+void emulate_instruction(chip8_t *chip8, const config_t *config)
+{
+    if (chip8->trace)
+        emulate_instruction_traced(chip8, config);
+    else if (config->engine == ENGINE_DECODE)
+        emulate_instruction_decode(chip8, config);
+    else
+        emulate_instruction_cached(chip8, config);
+}
+
+// Run count instructions, picking the engine once rather than per step. The block engines
+// finish the block they are in, so may run more. Returns the number of instructions executed
+uint32_t emulate_instructions(chip8_t *chip8, const config_t *config, uint32_t count)
+{
+    if (chip8->trace)
+    {
+        for (uint32_t i = 0; i < count; i++)
+            emulate_instruction_traced(chip8, config);
+        return count;
+    }
+
+    switch (config->engine)
+    {
+    case ENGINE_DECODE:
+        for (uint32_t i = 0; i < count; i++)
+            emulate_instruction_decode(chip8, config);
+        return count;
+    case ENGINE_BLOCK:
+        return emulate_blocks(chip8, config, count, false);
+    case ENGINE_JIT:
+        return emulate_blocks(chip8, config, count, true);
+    case ENGINE_CACHED:
+    default:
+        for (uint32_t i = 0; i < count; i++)
+            emulate_instruction_cached(chip8, config);
+        return count;
+    }
+}
+
+// VIP timing: run until the cycles left in the frame are spent, picking the engine once rather
+// than per step. Returns the number of instructions executed
+static uint32_t emulate_cycles(chip8_t *chip8, const config_t *config)
+{
+    uint32_t executed = 0;
+    uint16_t cycles;
+    if (chip8->trace)
+    {
+        for (; chip8->cycles > 0; executed++)
+        {
+            cycles = emulate_instruction_traced(chip8, config);
+            chip8->cycles -= cycles;
+        }
+        return executed;
+    }
+
+    switch (config->engine)
+    {
+    case ENGINE_DECODE:
+        for (; chip8->cycles > 0; executed++)
+        {
+            cycles = emulate_instruction_decode(chip8, config);
+            chip8->cycles -= cycles;
+        }
+        return executed;
+    case ENGINE_BLOCK:
+        return emulate_blocks_vip(chip8, config, false);
+    case ENGINE_JIT:
+        return emulate_blocks_vip(chip8, config, true);
+    case ENGINE_CACHED:
+    default:
+        for (; chip8->cycles > 0; executed++)
+        {
+            cycles = emulate_instruction_cached(chip8, config);
+            chip8->cycles -= cycles;
+        }
+        return executed;
+    }
+}
+
+// End of a frame: the frame's sound goes out, then the timers tick
+void update_timers(chip8_t *chip8)
+{
+    if (chip8->audio)
+        push_audio(chip8->audio, chip8);
+    if (chip8->delay_timer > 0)
+        chip8->delay_timer--;
+    if (chip8->sound_timer > 0)
+        chip8->sound_timer--;
+#ifdef PROFILE
+    chip8->profile.frames++;
+    chip8->profile.draw_frames += chip8->profile.drew;
+    chip8->profile.drew = false;
+#endif
+}
+
+// Instructions in the current frame. The CPU rate need not be a multiple of 60: frame n runs
+// the instructions between n and n + 1 sixtieths of a second, so no time is lost
+static uint32_t frame_instructions(const chip8_t *chip8, const config_t *config)
+{
+    const uint64_t ips = config->instructions_per_second;
+    return (chip8->frame + 1) * ips / FRAME_RATE - chip8->frame * ips / FRAME_RATE;
+}
+
+// Instructions still to run in the current frame. None when the last block of the frames
+// before already ran past this one too
+static uint32_t frame_left(const chip8_t *chip8, uint32_t total)
+{
+    return chip8->frame_done < total ? total - chip8->frame_done : 0;
+}
+
+static void end_frame(chip8_t *chip8, const config_t *config)
+{
+    update_timers(chip8);
+    chip8->frame++;
+    chip8->frame_done = 0;
+    if (config->timing == TIMING_VIP)
+        chip8->cycles += VIP_FRAME_CYCLES; // Less what the last instruction overran
+
+    if (chip8->debug && chip8->frame == chip8->debug->run_to_frame)
+    {
+        chip8->debug->run_to_frame = 0;
+        debug_stop(chip8, DEBUG_FRAME, 0);
+    }
+}
+
+// End of a frame of total instructions under flat timing. What the last block ran past it
+// counts towards the next frame, which is that much shorter
+static void end_flat_frame(chip8_t *chip8, const config_t *config, uint32_t total)
+{
+    const uint32_t overrun = chip8->frame_done - total;
+    end_frame(chip8, config);
+    chip8->frame_done = overrun;
+}
+
+// With a debugger attached the frame may stop part way. Dispatches parked on the stop did
+// not run, the rest of the frame runs once the debugger continues
+static uint32_t emulate_frame_debug(chip8_t *chip8, const config_t *config)
+{
+    debugger_t *debug = chip8->debug;
+    if (debug->stopped)
+        return 0;
+
+    debug->parked = 0;
+    debug->parked_cycles = 0;
+    if (config->timing == TIMING_VIP)
+    {
+        const uint32_t executed = emulate_cycles(chip8, config) - debug->parked;
+        chip8->cycles += debug->parked_cycles;
+        chip8->frame_done += executed;
+        if (chip8->cycles <= 0)
+            end_frame(chip8, config);
+        return executed;
+    }
+
+    const uint32_t total = frame_instructions(chip8, config);
+    const uint32_t executed = emulate_instructions(chip8, config, frame_left(chip8, total)) - debug->parked;
+    chip8->frame_done += executed;
+    if (chip8->frame_done >= total)
+        end_flat_frame(chip8, config, total);
+    return executed;
+}
+
+// Emulate one 60hz frame, then tick the timers. Returns the instructions executed
+uint32_t emulate_frame(chip8_t *chip8, const config_t *config)
+{
+    if (chip8->debug)
+        return emulate_frame_debug(chip8, config);
+
+    if (config->timing == TIMING_VIP)
+    {
+        const uint32_t executed = emulate_cycles(chip8, config);
+        end_frame(chip8, config);
+        return executed;
+    }
+
+    const uint32_t total = frame_instructions(chip8, config);
+    const uint32_t executed = emulate_instructions(chip8, config, frame_left(chip8, total));
+    chip8->frame_done += executed;
+    end_flat_frame(chip8, config, total);
+    return executed;
+}
+
+// Run the instruction at PC as part of the current frame, even if a breakpoint is armed there.
+// How a debugger steps, and steps off the instruction it stopped on
+void step_instruction(chip8_t *chip8, const config_t *config)
+{
+    instruction_t inst;
+    const uint16_t pc = chip8->PC & 0xFFF;
+    decode_fetched(chip8, config, pc, &inst);
+    chip8->PC += 2;
+    inst.handler(chip8, &inst, config);
+    if (chip8->trace)
+        trace_instruction(chip8, pc, inst.opcode);
+    if (config->timing == TIMING_VIP)
+    {
+        chip8->cycles -= inst.cycles;
+        chip8->frame_done++;
+        if (chip8->cycles <= 0)
+            end_frame(chip8, config);
+    }
+    else
+    {
+        const uint32_t total = frame_instructions(chip8, config);
+        if (++chip8->frame_done >= total)
+            end_flat_frame(chip8, config, total);
+    }
+}
+
+void init_scheduler(scheduler_t *sched, uint64_t now_ns)
+{
+    sched->origin_ns = now_ns;
+    sched->slots = 0;
+    sched->dropped = 0;
+}
+
+// Number of frames to emulate now. A host that fell behind catches up at most
+// SCHEDULER_CATCHUP frames at once and drops the rest instead of spiralling
+uint32_t scheduler_due(scheduler_t *sched, uint64_t now_ns)
+{
+    if (now_ns < sched->origin_ns)
+        return 0;
+    const uint64_t elapsed = (now_ns - sched->origin_ns) * FRAME_RATE / 1000000000ULL + 1;
+    if (elapsed <= sched->slots)
+        return 0;
+
+    uint64_t due = elapsed - sched->slots;
+    if (due > SCHEDULER_CATCHUP)
+    {
+        sched->dropped += due - SCHEDULER_CATCHUP;
+        due = SCHEDULER_CATCHUP;
+    }
+    sched->slots = elapsed;
+    return due;
+}
+
+// Clock time the next frame is due, for the frontend to sleep until. Computed from the
+// origin so rounding never accumulates
+uint64_t scheduler_next_ns(const scheduler_t *sched)
+{
+    return sched->origin_ns + sched->slots * 1000000000ULL / FRAME_RATE;
+}
+
+// Read-only view of the framebuffer for renderers and tools, instead of handing out the machine
+framebuffer_t get_framebuffer(const chip8_t *chip8)
+{
+    const uint32_t height = chip8->hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+    framebuffer_t fb = {
+        .width = chip8->hires ? HIRES_WIDTH : DISPLAY_WIDTH,
+        .height = height,
+        .planes = chip8->extension == EXT_XOCHIP ? DISPLAY_PLANES : 1,
+        .dirty_rows = chip8->dirty_rows & (~0ULL >> (64 - height)),
+    };
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        for (uint32_t w = 0; w < DISPLAY_WORDS; w++)
+            fb.rows[p][w] = chip8->display[p][w];
+    }
+    return fb;
+}
+
+// FNV-1a hash of the framebuffer, used to compare runs without a window.
+// Pixels are hashed row by row, leftmost pixel first, 8 pixels per byte, then the next
+// plane the same way
+uint64_t hash_display(const chip8_t *chip8)
+{
+    const framebuffer_t fb = get_framebuffer(chip8);
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t p = 0; p < fb.planes; p++)
+    {
+        for (uint32_t y = 0; y < fb.height; y++)
+        {
+            for (uint32_t w = 0; w < fb.width / 64; w++)
+            {
+                for (int shift = 56; shift >= 0; shift -= 8)
+                {
+                    hash ^= (fb.rows[p][w][y] >> shift) & 0xFF;
+                    hash *= 0x100000001B3ULL;
+                }
+            }
+        }
+    }
+    return hash;
+}
+
+// Free what a machine owns outside of chip8_t
+void release_chip8(chip8_t *chip8)
+{
+#ifdef JIT
+    jit_release(chip8);
+#else
+    (void)chip8;
+#endif
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Step-through debugger on top of the PAUSED state. Breakpoints and watchpoints are armed
+// by redecoding: core.c turns armed addresses into trap handlers when it predecodes them,
+// so a machine runs at full speed, in any engine, until one is hit. Every change of what is
+// armed therefore drops the predecoded code. Watchpoints are on RAM writes and on changes
+// of I, and stop after the instruction; breakpoints stop before it.
+
+static const char *fault_names[] = {
+    [FAULT_NONE] = "no fault",
+    [FAULT_FETCH] = "fetch past the end of RAM",
+    [FAULT_RAM_READ] = "read past the end of RAM",
+    [FAULT_RAM_WRITE] = "write past the end of RAM",
+    [FAULT_STACK_OVERFLOW] = "stack overflow",
+    [FAULT_STACK_UNDERFLOW] = "return with an empty stack",
+    [FAULT_KEY] = "key out of range",
+};
+
+static const char *reason_names[] = {
+    [DEBUG_NONE] = "running",
+    [DEBUG_USER] = "stopped",
+    [DEBUG_BREAKPOINT] = "breakpoint",
+    [DEBUG_WATCH_RAM] = "RAM watchpoint",
+    [DEBUG_WATCH_I] = "I watchpoint",
+    [DEBUG_FRAME] = "run to frame",
+    [DEBUG_STEP] = "step",
+};
+
+void attach_debugger(chip8_t *chip8, debugger_t *debug)
+{
+    memset(debug, 0, sizeof *debug);
+    chip8->debug = debug;
+    invalidate_code(chip8);
+}
+
+// The machine carries on from wherever it is, mid-frame included
+void detach_debugger(chip8_t *chip8)
+{
+    if (chip8->debug && chip8->debug->stopped)
+        chip8->state = RUNNING;
+    chip8->debug = NULL;
+    invalidate_code(chip8);
+}
+
+void set_breakpoint(chip8_t *chip8, uint16_t address, bool armed)
+{
+    chip8->debug->breakpoints[address & 0xFFF] = armed;
+    invalidate_code(chip8);
+}
+
+void set_watchpoint(chip8_t *chip8, uint16_t address, bool armed)
+{
+    chip8->debug->watched[address & 0xFFF] = armed;
+    invalidate_code(chip8);
+}
+
+void set_watch_i(chip8_t *chip8, bool armed)
+{
+    chip8->debug->watch_i = armed;
+    invalidate_code(chip8);
+}
+
+// Stop when the given frame starts
+void run_to_frame(chip8_t *chip8, uint64_t frame)
+{
+    chip8->debug->run_to_frame = frame > chip8->frame ? frame : 0;
+}
+
+// Stop between frames, as if a breakpoint was at PC
+void debug_break(chip8_t *chip8)
+{
+    if (!chip8->debug->stopped)
+        debug_stop(chip8, DEBUG_USER, chip8->PC & 0xFFF);
+}
+
+// Run one instruction and stay stopped
+void debug_step(chip8_t *chip8, const config_t *config)
+{
+    debugger_t *debug = chip8->debug;
+    if (!debug->stopped)
+        debug_break(chip8);
+    debug->reason = DEBUG_NONE;
+    step_instruction(chip8, config);
+    if (debug->reason == DEBUG_NONE)
+        debug->reason = DEBUG_STEP;
+}
+
+// Resume. The instruction the machine stopped on runs first, breakpoint or not; if it hits a
+// watchpoint itself the machine stays stopped
+void debug_continue(chip8_t *chip8, const config_t *config)
+{
+    debugger_t *debug = chip8->debug;
+    if (!debug->stopped)
+        return;
+    debug->reason = DEBUG_NONE;
+    step_instruction(chip8, config);
+    if (debug->reason != DEBUG_NONE)
+        return;
+
+    debug->stopped = false;
+    debug->stop_pending = false;
+    invalidate_code(chip8); // Drops the parking trap, rearms the rest
+    chip8->state = RUNNING;
+}
+
+// Where the machine stopped and why, its registers and the next instruction
+void print_debug_stop(const chip8_t *chip8, FILE *out)
+{
+    const debugger_t *debug = chip8->debug;
+    const uint16_t pc = chip8->PC & 0xFFF;
+    char text[32];
+    disassemble((chip8->ram[pc] << 8) | chip8->ram[(pc + 1) & 0xFFF], text, sizeof text);
+
+    fprintf(out, "%s", reason_names[debug->reason]);
+    if (debug->reason == DEBUG_WATCH_RAM)
+        fprintf(out, " 0x%03X = %02X", debug->address, chip8->ram[debug->address]);
+    else if (debug->reason == DEBUG_WATCH_I)
+        fprintf(out, " %03X -> %03X", debug->old_I, chip8->I);
+    fprintf(out, ", frame %llu + %u instructions\n", (unsigned long long)chip8->frame, chip8->frame_done);
+
+    fprintf(out, "  PC=%03X  %s\n  I=%03X DT=%02X ST=%02X\n ", pc, text, chip8->I, chip8->delay_timer, chip8->sound_timer);
+    for (int i = 0; i < 16; i++)
+        fprintf(out, " V%X=%02X", i, chip8->V[i]);
+    fprintf(out, "\n  stack:");
+    for (int i = 0; i < chip8->stack_depth; i++)
+        fprintf(out, " %03X", chip8->stack[i]);
+    fprintf(out, "\n");
+}
+
+// What a CHECKED build trapped, if anything
+void print_fault(const chip8_t *chip8, FILE *out)
+{
+    const fault_t *fault = &chip8->fault;
+    if (!fault->reason)
+        return;
+    char text[32];
+    disassemble(fault->opcode, text, sizeof text);
+    fprintf(out, "fault: %s at PC=%03X  %s", fault_names[fault->reason], fault->pc, text);
+    if (fault->reason == FAULT_STACK_OVERFLOW)
+        fprintf(out, ", %u return addresses\n", fault->address);
+    else if (fault->reason == FAULT_KEY)
+        fprintf(out, ", key %02X\n", fault->address);
+    else if (fault->reason != FAULT_STACK_UNDERFLOW)
+        fprintf(out, ", address %04X\n", fault->address);
+    else
+        fprintf(out, "\n");
+}
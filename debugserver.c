@@ -0,0 +1,360 @@
+#define _DEFAULT_SOURCE // fdopen, getline, MSG_NOSIGNAL
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "chip8.h"
+
+// Debug server for the headless runner (POSIX): a small line protocol on a Unix socket, served
+// by its own thread, one client at a time. The server thread never touches the machine. It
+// posts each request in a mailbox and waits for the reply; the emulation thread looks at the
+// mailbox between frames with a trylock and answers there, so it never waits on the server or
+// a client. A memory read is copied out in one piece and sent as a single reply.
+//
+// Requests and replies are one line each, numbers in hex:
+//   ?              state: "running frame F" or "stopped <reason> frame F pc P"
+//   g              registers: "PC I DT ST V0..VF STACK", V and the stack as runs of hex digits
+//   m addr len     read RAM, all of the machine's (64 KB on XO-CHIP): the bytes as one run of hex digits
+//   M addr bytes   write RAM from a run of hex digits, two per byte
+//   Z addr, z addr set and clear a breakpoint
+//   W addr, w addr set and clear a RAM watchpoint
+//   b              stop the machine at the next frame boundary
+//   s              step one instruction (stops the machine first if needed)
+//   c              continue
+// Anything else, or a bad argument, gets "E <message>". Successful commands without data
+// get "OK".
+
+// Sized for the largest machine, all of its RAM in one line
+#define REQUEST_SIZE (2 * XO_RAM_SIZE + 32)
+#define REPLY_SIZE (2 * XO_RAM_SIZE + 64)
+
+struct debug_server
+{
+    pthread_t thread;
+    int listen_fd;
+    int client_fd; // -1 = no client
+    char *path;
+
+    pthread_mutex_t lock;   // Guards everything below
+    pthread_cond_t replied;
+    bool pending;           // request waits for the emulation thread
+    bool quit;
+    char request[REQUEST_SIZE];
+    char reply[REPLY_SIZE];
+};
+
+static const char *reason_names[] = {
+    [DEBUG_NONE] = "none",
+    [DEBUG_USER] = "user",
+    [DEBUG_BREAKPOINT] = "breakpoint",
+    [DEBUG_WATCH_RAM] = "watch-ram",
+    [DEBUG_WATCH_I] = "watch-i",
+    [DEBUG_FRAME] = "frame",
+    [DEBUG_STEP] = "step",
+};
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static char *put_hex(char *out, const uint8_t *bytes, size_t n)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++)
+    {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0xF];
+    }
+    *out = '\0';
+    return out;
+}
+
+// Parse "addr" or "addr len" operands, checking they stay below limit
+static bool parse_range(const char *args, unsigned *address, unsigned *len, bool with_len, unsigned limit)
+{
+    char *end;
+    *address = strtoul(args, &end, 16);
+    if (end == args || *address >= limit)
+        return false;
+    if (!with_len)
+        return true;
+    args = end;
+    *len = strtoul(args, &end, 16);
+    return end != args && *len <= limit - *address;
+}
+
+// Runs on the emulation thread, between frames
+static void handle_request(const char *request, char *reply, chip8_t *chip8, const config_t *config)
+{
+    debugger_t *debug = chip8->debug;
+    const char *args = request + 1;
+    const unsigned ram_size = EXT_RAM_SIZE(chip8->extension);
+    unsigned address, len;
+
+    switch (request[0])
+    {
+    case '?':
+        if (debug->stopped)
+            snprintf(reply, REPLY_SIZE, "stopped %s frame %llx pc %03x", reason_names[debug->reason],
+                     (unsigned long long)chip8->frame, chip8->PC & 0xFFF);
+        else
+            snprintf(reply, REPLY_SIZE, "running frame %llx", (unsigned long long)chip8->frame);
+        return;
+    case 'g':
+    {
+        char *out = reply + sprintf(reply, "%03x %03x %02x %02x ", chip8->PC, chip8->I, chip8->delay_timer,
+                                    chip8->sound_timer);
+        out = put_hex(out, chip8->V, sizeof chip8->V);
+        *out++ = ' ';
+        for (int i = 0; i < chip8->stack_depth; i++)
+            out += sprintf(out, "%04x", chip8->stack[i]);
+        *out = '\0';
+        return;
+    }
+    case 'm':
+        if (!parse_range(args, &address, &len, true, ram_size))
+            break;
+        put_hex(reply, &chip8->ram[address], len);
+        return;
+    case 'M':
+    {
+        char *end;
+        address = strtoul(args, &end, 16);
+        while (*end == ' ')
+            end++;
+        const size_t digits = strlen(end);
+        len = digits / 2;
+        if (end == args || address >= ram_size || len > ram_size - address)
+            break;
+        // Check every digit before writing anything
+        if (digits % 2)
+        {
+            snprintf(reply, REPLY_SIZE, "E odd number of hex digits");
+            return;
+        }
+        for (size_t i = 0; i < digits; i++)
+        {
+            if (hex_digit(end[i]) < 0)
+            {
+                snprintf(reply, REPLY_SIZE, "E bad hex");
+                return;
+            }
+        }
+        for (unsigned i = 0; i < len; i++)
+            chip8->ram[address + i] = hex_digit(end[2 * i]) << 4 | hex_digit(end[2 * i + 1]);
+        invalidate_code(chip8); // The engines may have decoded the old bytes
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    }
+    case 'Z':
+    case 'z':
+        if (!parse_range(args, &address, &len, false, RAM_SIZE)) // Code and traps are in the low 4 KB
+            break;
+        set_breakpoint(chip8, address, request[0] == 'Z');
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    case 'W':
+    case 'w':
+        if (!parse_range(args, &address, &len, false, RAM_SIZE)) // Code and traps are in the low 4 KB
+            break;
+        set_watchpoint(chip8, address, request[0] == 'W');
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    case 'b':
+        debug_break(chip8);
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    case 's':
+        debug_step(chip8, config);
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    case 'c':
+        debug_continue(chip8, config);
+        snprintf(reply, REPLY_SIZE, "OK");
+        return;
+    default:
+        snprintf(reply, REPLY_SIZE, "E unknown command");
+        return;
+    }
+    snprintf(reply, REPLY_SIZE, "E bad address or length");
+}
+
+// Called by the emulation thread between frames. Never waits: if the server thread holds
+// the mailbox, the request is answered at a later frame
+void poll_debug_server(debug_server_t *server, chip8_t *chip8, const config_t *config)
+{
+    if (pthread_mutex_trylock(&server->lock))
+        return;
+    if (server->pending)
+    {
+        handle_request(server->request, server->reply, chip8, config);
+        server->pending = false;
+        pthread_cond_signal(&server->replied);
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+static bool send_line(int fd, const char *line)
+{
+    const size_t len = strlen(line);
+    for (size_t sent = 0; sent < len + 1;)
+    {
+        const char *data = sent < len ? line + sent : "\n";
+        const ssize_t n = send(fd, data, sent < len ? len - sent : 1, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Post a request and wait for the emulation thread to answer it
+static bool exchange(debug_server_t *server, const char *request, char *reply)
+{
+    pthread_mutex_lock(&server->lock);
+    snprintf(server->request, sizeof server->request, "%s", request);
+    server->pending = true;
+    while (server->pending && !server->quit)
+        pthread_cond_wait(&server->replied, &server->lock);
+    const bool answered = !server->pending;
+    if (answered)
+        memcpy(reply, server->reply, REPLY_SIZE);
+    server->pending = false;
+    pthread_mutex_unlock(&server->lock);
+    return answered;
+}
+
+static void serve_client(debug_server_t *server, int fd)
+{
+    FILE *in = fdopen(dup(fd), "r");
+    if (!in)
+        return;
+    static char reply[REPLY_SIZE]; // Only this thread uses it
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, in)) > 0)
+    {
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (!len)
+            continue;
+        if (len >= REQUEST_SIZE)
+            snprintf(reply, sizeof reply, "E request too long");
+        else if (!exchange(server, line, reply))
+            break;
+        if (!send_line(fd, reply))
+            break;
+    }
+    free(line);
+    fclose(in);
+}
+
+static void *server_thread(void *arg)
+{
+    debug_server_t *server = arg;
+    for (;;)
+    {
+        const int fd = accept(server->listen_fd, NULL, NULL);
+        pthread_mutex_lock(&server->lock);
+        const bool quit = server->quit;
+        server->client_fd = quit ? -1 : fd;
+        pthread_mutex_unlock(&server->lock);
+        if (quit)
+        {
+            if (fd >= 0)
+                close(fd);
+            return NULL;
+        }
+        if (fd < 0)
+            continue;
+
+        serve_client(server, fd);
+        pthread_mutex_lock(&server->lock);
+        server->client_fd = -1;
+        pthread_mutex_unlock(&server->lock);
+        close(fd);
+    }
+}
+
+// Listen on a Unix socket at path, replacing a stale socket left there
+debug_server_t *start_debug_server(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path)
+    {
+        printf("Debug socket path too long: %s\n", path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    debug_server_t *server = calloc(1, sizeof *server);
+    if (!server)
+        return NULL;
+    server->client_fd = -1;
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr *)&addr, sizeof addr) ||
+        listen(server->listen_fd, 1))
+    {
+        printf("Could not listen on %s\n", path);
+        if (server->listen_fd >= 0)
+            close(server->listen_fd);
+        free(server);
+        return NULL;
+    }
+    server->path = strdup(path);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->replied, NULL);
+    if (pthread_create(&server->thread, NULL, server_thread, server))
+    {
+        printf("Could not start the debug server thread\n");
+        close(server->listen_fd);
+        unlink(path);
+        free(server->path);
+        free(server);
+        return NULL;
+    }
+    printf("debug server listening on %s\n", path);
+    return server;
+}
+
+// Drop the client, stop the thread and remove the socket
+void stop_debug_server(debug_server_t *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->quit = true;
+    pthread_cond_signal(&server->replied);
+    if (server->client_fd >= 0)
+        shutdown(server->client_fd, SHUT_RDWR);
+    pthread_mutex_unlock(&server->lock);
+
+    // Wake accept with a connection of our own, the thread sees quit and leaves
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, server->path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0)
+    {
+        connect(fd, (struct sockaddr *)&addr, sizeof addr);
+        close(fd);
+    }
+
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    unlink(server->path);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->replied);
+    free(server->path);
+    free(server);
+}
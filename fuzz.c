@@ -0,0 +1,631 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "chip8.h"
+
+// Coverage-guided ROM fuzzer for the headless runner (POSIX). One worker process per core
+// mutates ROMs from a shared corpus and runs each for a fixed instruction budget, pressing
+// keys on a fixed schedule so every run is repeatable from the ROM alone. Coverage comes
+// from the instruction trace: an instruction is the handler the core decodes its opcode to and
+// the 256 byte page of its PC, each pair of consecutive instructions is an edge, counted AFL
+// style into hit buckets. Handlers rather than raw opcodes, or every operand value would be
+// an edge of its own and flood the map. Any run that reaches an edge or bucket no worker has
+// seen is saved to the queue and joins the corpus. Every edge remembers the smallest corpus
+// input reaching it, AFL's favored inputs: once the corpus is full a new input replaces the
+// entry that is the smallest for the fewest edges, none when there is such an entry, so
+// the corpus keeps small inputs for as many edges as it can however long the run goes. The map, the corpus and each worker's current input live in memory shared
+// across the forks, so a worker that dies (a crash, or a sanitizer report in
+// make fuzz builds) or stops making progress (a hang) leaves its input behind for the
+// parent, which saves it and forks a replacement.
+//
+// out_dir/queue holds the inputs that found new coverage, out_dir/crashes and out_dir/hangs
+// what killed a worker. --fuzz-run replays one input exactly as the workers ran it.
+
+#define FUZZ_MAP_SIZE (1u << 16) // Edge hit counters
+#define FUZZ_CORPUS 8192         // Inputs the shared corpus holds, then finds replace the least favored
+#define FUZZ_MAX_ROM (RAM_SIZE - ENTRY_POINT) // Code only runs from the low 4 KB on every machine
+#define FUZZ_TRACE (1u << 16)    // Trace ring, folded into the map after every frame
+#define FUZZ_HANG_MS 2000        // A worker whose run takes longer than this is hung
+#define FUZZ_STACK 8             // Most mutations stacked on one input
+
+typedef struct
+{
+    uint32_t size;
+    uint8_t data[FUZZ_MAX_ROM];
+} fuzz_input_t;
+
+// Per worker, shared with the parent
+typedef struct
+{
+    _Atomic uint64_t execs; // Runs finished, the parent's heartbeat
+    fuzz_input_t input;     // Run in progress
+} fuzz_slot_t;
+
+typedef struct
+{
+    _Atomic uint8_t seen[FUZZ_MAP_SIZE];   // Hit buckets any worker has reached, per edge
+    _Atomic uint32_t edges;                // Edges seen at all
+    _Atomic uint32_t top[FUZZ_MAP_SIZE];   // Smallest input reaching each edge, (size + 1) << 16 | index, 0 = none
+    _Atomic uint32_t corpus_count;         // May run past FUZZ_CORPUS, later inputs replace entries
+    _Atomic uint32_t replaced;             // Entries replaced since the corpus filled up
+    _Atomic bool stop;
+    _Atomic uint32_t seq[FUZZ_CORPUS];     // 0 = empty, odd = being written, even = readers may copy it
+    _Atomic uint32_t favored[FUZZ_CORPUS]; // Edges each entry is the smallest input for
+    fuzz_input_t corpus[FUZZ_CORPUS];
+    fuzz_slot_t slots[];
+} fuzz_shared_t;
+
+// One worker's machine and the coverage of its current run
+typedef struct
+{
+    const config_t *config;
+    uint64_t budget; // Instructions per run
+    chip8_t chip8;
+    trace_t trace;
+    uint64_t folded; // Trace steps already in the map
+    uint32_t prev;   // Previous instruction's edge half
+    uint8_t hits[FUZZ_MAP_SIZE];
+    uint16_t touched[FUZZ_MAP_SIZE]; // Counters this run made nonzero
+    uint32_t ntouched;
+} fuzz_run_t;
+
+// The parent's view of a worker process
+typedef struct
+{
+    pid_t pid;
+    uint64_t execs;       // At the last progress
+    uint64_t progress_ns; // When execs last moved
+    bool hung;            // Killed by the parent
+} fuzz_worker_t;
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// FNV-1a, names saved inputs by content
+static uint64_t hash_input(const fuzz_input_t *input)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t i = 0; i < input->size; i++)
+        hash = (hash ^ input->data[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+static bool init_run(fuzz_run_t *run, const config_t *config, uint64_t budget)
+{
+    memset(run, 0, sizeof *run);
+    run->config = config;
+    run->budget = budget;
+    return init_trace(&run->trace, FUZZ_TRACE);
+}
+
+static void release_run(fuzz_run_t *run)
+{
+    release_trace(&run->trace);
+    release_chip8(&run->chip8);
+}
+
+// Add the instructions traced since the last fold to this run's counters. A frame longer
+// than the ring only counts its last FUZZ_TRACE instructions
+static void fold_coverage(fuzz_run_t *run)
+{
+    const trace_t *trace = &run->trace;
+    uint64_t step = run->folded;
+    if (trace->steps - step > (uint64_t)trace->mask + 1)
+        step = trace->steps - trace->mask - 1;
+    for (; step < trace->steps; step++)
+    {
+        const trace_entry_t *entry = &trace->entries[step & trace->mask];
+        const instruction_t *cached = &run->chip8.icache[entry->pc];
+        instruction_t inst;
+        if (!cached->handler || cached->opcode != entry->opcode)
+        {
+            decode_instruction(&run->chip8, run->config, entry->opcode, &inst); // Rewritten since
+            cached = &inst;
+        }
+        const uint32_t cur = mix((uint64_t)(uintptr_t)cached->handler ^ (uint64_t)(entry->pc >> 8) << 48) & (FUZZ_MAP_SIZE - 1);
+        const uint32_t edge = cur ^ run->prev;
+        if (!run->hits[edge])
+            run->touched[run->ntouched++] = edge;
+        if (run->hits[edge] < 255)
+            run->hits[edge]++;
+        run->prev = cur >> 1;
+    }
+    run->folded = trace->steps;
+}
+
+// Run one input from a fresh machine: the budget in frames at the configured CPU speed,
+// with a new set of keys held down every frame. Returns the instructions executed
+static uint64_t run_input(fuzz_run_t *run, const fuzz_input_t *input)
+{
+    chip8_t *chip8 = &run->chip8;
+    init_chip8_from_memory(chip8, run->config, input->data, input->size, "fuzz");
+    run->trace.steps = 0;
+    run->folded = 0;
+    run->prev = 0;
+    run->ntouched = 0;
+    chip8->trace = &run->trace;
+
+    uint64_t executed = 0;
+    while (executed < run->budget && chip8->state == RUNNING)
+    {
+        const uint64_t keys = mix(chip8->frame) & mix(~chip8->frame); // About 4 keys down
+        for (int i = 0; i < 16; i++)
+            chip8->keypad[i] = (keys >> i) & 1;
+        executed += emulate_frame(chip8, run->config);
+        fold_coverage(run);
+    }
+    return executed;
+}
+
+// Hit count bucket of a counter, one bit each: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static uint8_t bucket(uint8_t hits)
+{
+    if (hits <= 3)
+        return 1 << (hits - 1);
+    if (hits < 8)
+        return 8;
+    if (hits < 16)
+        return 16;
+    if (hits < 32)
+        return 32;
+    return hits < 128 ? 64 : 128;
+}
+
+// Merge this run's counters into the shared map, clearing them; the list of edges the run
+// touched stays for add_to_corpus. True if anything was new
+static bool merge_coverage(fuzz_run_t *run, fuzz_shared_t *shared)
+{
+    bool novel = false;
+    for (uint32_t i = 0; i < run->ntouched; i++)
+    {
+        const uint32_t edge = run->touched[i];
+        const uint8_t bits = bucket(run->hits[edge]);
+        run->hits[edge] = 0;
+        if (!(bits & ~atomic_load_explicit(&shared->seen[edge], memory_order_relaxed)))
+            continue;
+        const uint8_t old = atomic_fetch_or_explicit(&shared->seen[edge], bits, memory_order_relaxed);
+        if (bits & ~old)
+        {
+            novel = true;
+            if (!old)
+                atomic_fetch_add_explicit(&shared->edges, 1, memory_order_relaxed);
+        }
+    }
+    return novel;
+}
+
+static void save_input(const fuzz_input_t *input, const char *out_dir, const char *dir)
+{
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s/%016llx.ch8", out_dir, dir, (unsigned long long)hash_input(input));
+    FILE *out = fopen(path, "wb");
+    if (!out || (input->size && fwrite(input->data, input->size, 1, out) != 1))
+        printf("Could not write %s\n", path);
+    if (out)
+        fclose(out);
+}
+
+// Take the entry that is the smallest input for the fewest edges for writing, and drop it
+// from those edges. Returns its index, its sequence number before the claim goes to seq.
+// Only the writer of an entry makes it favored, so once claimed it can only lose edges
+static uint32_t claim_victim(fuzz_shared_t *shared, uint64_t *rng, uint32_t *seq)
+{
+    for (;;)
+    {
+        const uint32_t first = next_random(rng) % FUZZ_CORPUS;
+        uint32_t victim = first, fewest = UINT32_MAX;
+        for (uint32_t i = 0; i < FUZZ_CORPUS && fewest; i++)
+        {
+            const uint32_t index = (first + i) % FUZZ_CORPUS;
+            const uint32_t written = atomic_load_explicit(&shared->seq[index], memory_order_relaxed);
+            const uint32_t favored = atomic_load_explicit(&shared->favored[index], memory_order_relaxed);
+            if (written && !(written & 1) && favored < fewest)
+            {
+                victim = index;
+                fewest = favored;
+            }
+        }
+        *seq = atomic_load_explicit(&shared->seq[victim], memory_order_relaxed);
+        if (!*seq || *seq & 1 ||
+            !atomic_compare_exchange_strong_explicit(&shared->seq[victim], seq, *seq + 1, memory_order_acquire,
+                                                     memory_order_relaxed))
+            continue; // Another worker took it first
+
+        for (uint32_t edge = 0; atomic_load_explicit(&shared->favored[victim], memory_order_relaxed) && edge < FUZZ_MAP_SIZE; edge++)
+        {
+            uint32_t top = atomic_load_explicit(&shared->top[edge], memory_order_relaxed);
+            if (top && (top & 0xFFFF) == victim &&
+                atomic_compare_exchange_strong_explicit(&shared->top[edge], &top, 0, memory_order_relaxed, memory_order_relaxed))
+                atomic_fetch_sub_explicit(&shared->favored[victim], 1, memory_order_relaxed);
+        }
+        return victim;
+    }
+}
+
+// Make entry index, held for writing, the smallest input of the edges the run touched
+// where it is smaller than the current one
+static void claim_edges(fuzz_shared_t *shared, const fuzz_run_t *run, uint32_t index, uint32_t size)
+{
+    const uint32_t mine = (size + 1) << 16 | index;
+    for (uint32_t i = 0; i < run->ntouched; i++)
+    {
+        _Atomic uint32_t *top = &shared->top[run->touched[i]];
+        uint32_t old = atomic_load_explicit(top, memory_order_relaxed);
+        while ((!old || mine >> 16 < old >> 16) &&
+               !atomic_compare_exchange_weak_explicit(top, &old, mine, memory_order_relaxed, memory_order_relaxed))
+            ;
+        if (old && mine >> 16 >= old >> 16)
+            continue;
+        if (old)
+            atomic_fetch_sub_explicit(&shared->favored[old & 0xFFFF], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shared->favored[index], 1, memory_order_relaxed);
+    }
+}
+
+// Put an input that found new coverage in the shared corpus: appended while there is room,
+// then in place of the least favored entry
+static void add_to_corpus(fuzz_shared_t *shared, const fuzz_run_t *run, const fuzz_input_t *input, uint64_t *rng)
+{
+    uint32_t index = atomic_load_explicit(&shared->corpus_count, memory_order_relaxed);
+    if (index < FUZZ_CORPUS)
+        index = atomic_fetch_add_explicit(&shared->corpus_count, 1, memory_order_relaxed);
+    uint32_t seq = 0;
+    if (index < FUZZ_CORPUS)
+        atomic_store_explicit(&shared->seq[index], 1, memory_order_relaxed);
+    else
+    {
+        index = claim_victim(shared, rng, &seq);
+        atomic_fetch_add_explicit(&shared->replaced, 1, memory_order_relaxed);
+    }
+    shared->corpus[index] = *input;
+    claim_edges(shared, run, index, input->size);
+    atomic_store_explicit(&shared->seq[index], seq + 2, memory_order_release);
+}
+
+// Copy a random corpus entry, retrying while the one picked is being written
+static void pick_input(fuzz_shared_t *shared, uint64_t *rng, fuzz_input_t *input)
+{
+    for (;;)
+    {
+        uint32_t count = atomic_load_explicit(&shared->corpus_count, memory_order_relaxed);
+        if (count > FUZZ_CORPUS)
+            count = FUZZ_CORPUS;
+        const uint32_t index = next_random(rng) % count;
+        const uint32_t seq = atomic_load_explicit(&shared->seq[index], memory_order_acquire);
+        if (!seq || seq & 1)
+            continue;
+        *input = shared->corpus[index];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shared->seq[index], memory_order_relaxed) == seq)
+            return;
+    }
+}
+
+// A stack of byte and opcode level mutations. CHIP-8 instructions are two bytes at even
+// addresses, so most mutations work on whole opcodes to keep the rest of the program aligned
+static void mutate(fuzz_input_t *input, fuzz_shared_t *shared, uint64_t *rng)
+{
+    static const uint8_t interesting[] = {0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xF0, 0xFE, 0xFF};
+    const int count = 1 + next_random(rng) % FUZZ_STACK;
+
+    for (int n = 0; n < count; n++)
+    {
+        const uint64_t r = next_random(rng);
+        uint32_t size = input->size;
+        uint8_t *data = input->data;
+        const uint32_t at = size ? (r >> 8) % size : 0;
+        const uint32_t op = at & ~1u;
+        int kind = r % 9;
+        if (size < 2 && kind != 5 && kind != 8)
+            kind = 5; // Nothing to change yet, grow it
+
+        switch (kind)
+        {
+        case 0: // Flip a bit
+            data[at] ^= 1 << ((r >> 40) & 7);
+            break;
+        case 1: // Random byte
+            data[at] = r >> 40;
+            break;
+        case 2: // Boundary value
+            data[at] = interesting[(r >> 40) % sizeof interesting];
+            break;
+        case 3: // Random opcode
+            data[op] = r >> 40;
+            data[op + 1] = r >> 48;
+            break;
+        case 4: // Change one nibble of an opcode
+        {
+            const int shift = 4 * ((r >> 40) & 3);
+            const uint16_t opcode = (data[op] << 8 | data[op + 1]) ^ (((r >> 44) & 0xF) << shift);
+            data[op] = opcode >> 8;
+            data[op + 1] = opcode;
+            break;
+        }
+        case 5: // Insert a random opcode
+            if (size + 2 > FUZZ_MAX_ROM)
+                break;
+            memmove(&data[op + 2], &data[op], size - op);
+            data[op] = r >> 40;
+            data[op + 1] = r >> 48;
+            input->size += 2;
+            break;
+        case 6: // Delete an opcode
+            if (op + 2 > size)
+                break;
+            memmove(&data[op], &data[op + 2], size - op - 2);
+            input->size -= 2;
+            break;
+        case 7: // Copy opcodes from elsewhere in the input
+        {
+            const uint32_t from = ((r >> 32) % size) & ~1u;
+            uint32_t len = 2 + 2 * ((r >> 48) % 8);
+            if (len > size - from)
+                len = size - from;
+            if (len > size - op)
+                len = size - op;
+            memmove(&data[op], &data[from], len);
+            break;
+        }
+        case 8: // Splice: keep the head, take the tail of another corpus input
+        {
+            static fuzz_input_t other; // One worker per process
+            pick_input(shared, rng, &other);
+            const uint32_t from = other.size ? ((r >> 32) % other.size) & ~1u : 0;
+            uint32_t len = other.size - from;
+            if (op + len > FUZZ_MAX_ROM)
+                len = FUZZ_MAX_ROM - op;
+            memcpy(&data[op], &other.data[from], len);
+            input->size = op + len;
+            break;
+        }
+        }
+    }
+}
+
+static void fuzz_worker(fuzz_shared_t *shared, int id, const config_t *config, uint64_t budget,
+                        const char *out_dir)
+{
+    signal(SIGINT, SIG_IGN); // The parent stops the workers itself
+    static fuzz_run_t run;
+    if (!init_run(&run, config, budget))
+        _exit(2);
+    uint64_t rng = mix(now_ns() ^ (uint64_t)id << 48 ^ getpid()) | 1;
+    fuzz_slot_t *slot = &shared->slots[id];
+
+    while (!atomic_load_explicit(&shared->stop, memory_order_relaxed))
+    {
+        pick_input(shared, &rng, &slot->input);
+        mutate(&slot->input, shared, &rng);
+        run_input(&run, &slot->input);
+        if (merge_coverage(&run, shared))
+        {
+            save_input(&slot->input, out_dir, "queue"); // Kept even when the corpus has no room for it
+            add_to_corpus(shared, &run, &slot->input, &rng);
+        }
+        atomic_fetch_add_explicit(&slot->execs, 1, memory_order_release);
+    }
+    release_run(&run);
+    _exit(0);
+}
+
+static bool read_input(fuzz_input_t *input, const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        printf("Could not open %s\n", path);
+        return false;
+    }
+    input->size = fread(input->data, 1, sizeof input->data, in);
+    const bool whole = fgetc(in) == EOF;
+    fclose(in);
+    if (!whole)
+        printf("%s is longer than %u bytes, fuzzing its start only\n", path, FUZZ_MAX_ROM);
+    return true;
+}
+
+static bool make_dirs(const char *out_dir)
+{
+    static const char *const subdirs[] = {"", "/queue", "/crashes", "/hangs"};
+    char path[4096];
+    for (size_t i = 0; i < sizeof subdirs / sizeof *subdirs; i++)
+    {
+        snprintf(path, sizeof path, "%s%s", out_dir, subdirs[i]);
+        struct stat st;
+        if (mkdir(path, 0755) && (stat(path, &st) || !S_ISDIR(st.st_mode)))
+        {
+            printf("Could not create %s\n", path);
+            return false;
+        }
+    }
+    return true;
+}
+
+static pid_t spawn_worker(fuzz_shared_t *shared, int id, const config_t *config, uint64_t budget,
+                          const char *out_dir)
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+        fuzz_worker(shared, id, config, budget, out_dir);
+    return pid;
+}
+
+// Fuzz until interrupted or for the given seconds. Returns 1 if anything crashed or hung
+int fuzz(const config_t *config, const char *out_dir, int nworkers, uint64_t seconds, uint64_t budget,
+         int nseeds, char **seeds)
+{
+    if (nworkers <= 0)
+        nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!make_dirs(out_dir))
+        return -1;
+
+    const size_t shared_size = sizeof(fuzz_shared_t) + nworkers * sizeof(fuzz_slot_t);
+    fuzz_shared_t *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        printf("Could not map %zu bytes of shared fuzzer state\n", shared_size);
+        return -1;
+    }
+
+    // The seeds go in first, with their coverage, so the workers only keep what is new
+    static fuzz_run_t run;
+    if (!init_run(&run, config, budget))
+        return -1;
+    static fuzz_input_t input;
+    uint64_t rng = mix(now_ns()) | 1;
+    for (int i = 0; i < nseeds; i++)
+    {
+        if (!read_input(&input, seeds[i]))
+            return -1;
+        run_input(&run, &input);
+        merge_coverage(&run, shared);
+        add_to_corpus(shared, &run, &input, &rng);
+    }
+    release_run(&run);
+    printf("fuzzing %s with %d seeds on %d workers, %llu instructions per run, results in %s\n",
+           extension_names[config->current_extension], nseeds, nworkers, (unsigned long long)budget, out_dir);
+
+    fuzz_worker_t *workers = calloc(nworkers, sizeof *workers);
+    const uint64_t start = now_ns();
+    for (int w = 0; w < nworkers; w++)
+    {
+        workers[w].pid = spawn_worker(shared, w, config, budget, out_dir);
+        workers[w].progress_ns = start;
+    }
+    signal(SIGINT, on_interrupt);
+
+    uint32_t crashes = 0, hangs = 0;
+    uint64_t last_report = start, last_execs = 0;
+    for (;;)
+    {
+        usleep(50000);
+        const uint64_t now = now_ns();
+        const bool done = interrupted || (seconds && now - start >= seconds * 1000000000ULL);
+
+        // Dead workers: save what they were running and replace them
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            for (int w = 0; w < nworkers; w++)
+            {
+                if (workers[w].pid != pid)
+                    continue;
+                if (workers[w].hung)
+                {
+                    hangs++;
+                    save_input(&shared->slots[w].input, out_dir, "hangs");
+                }
+                else
+                {
+                    crashes++;
+                    save_input(&shared->slots[w].input, out_dir, "crashes");
+                    printf("worker %d died (%s %d), input saved to %s/crashes\n", w,
+                           WIFSIGNALED(status) ? "signal" : "exit", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status),
+                           out_dir);
+                }
+                workers[w] = (fuzz_worker_t){.pid = done ? -1 : spawn_worker(shared, w, config, budget, out_dir),
+                                        .execs = atomic_load(&shared->slots[w].execs),
+                                        .progress_ns = now};
+            }
+        }
+
+        // Workers stuck on one input
+        uint64_t execs = 0;
+        for (int w = 0; w < nworkers; w++)
+        {
+            const uint64_t n = atomic_load(&shared->slots[w].execs);
+            execs += n;
+            if (n != workers[w].execs)
+            {
+                workers[w].execs = n;
+                workers[w].progress_ns = now;
+            }
+            else if (workers[w].pid > 0 && !workers[w].hung && now - workers[w].progress_ns > FUZZ_HANG_MS * 1000000ULL)
+            {
+                workers[w].hung = true;
+                kill(workers[w].pid, SIGKILL);
+            }
+        }
+
+        if (now - last_report >= 1000000000ULL || done)
+        {
+            const uint32_t corpus = atomic_load(&shared->corpus_count);
+            printf("%6.1f s  %12llu runs  %9.0f runs/s  corpus %5u  replaced %6u  edges %5u  crashes %u  hangs %u\n",
+                   (now - start) / 1e9, (unsigned long long)execs, (execs - last_execs) / ((now - last_report) / 1e9),
+                   corpus < FUZZ_CORPUS ? corpus : FUZZ_CORPUS, atomic_load(&shared->replaced), atomic_load(&shared->edges),
+                   crashes, hangs);
+            last_report = now;
+            last_execs = execs;
+        }
+        if (done)
+            break;
+    }
+
+    // Workers finish their run and leave
+    atomic_store(&shared->stop, true);
+    for (int w = 0; w < nworkers; w++)
+    {
+        if (workers[w].pid > 0)
+            waitpid(workers[w].pid, NULL, 0);
+    }
+    signal(SIGINT, SIG_DFL);
+    free(workers);
+    munmap(shared, shared_size);
+    return crashes || hangs ? 1 : 0;
+}
+
+// Run one input the way the workers do, to reproduce a crash or hang under a debugger or
+// a sanitizer
+int fuzz_run(const config_t *config, const char *path, uint64_t budget)
+{
+    static fuzz_run_t run;
+    static fuzz_input_t input;
+    if (!read_input(&input, path) || !init_run(&run, config, budget))
+        return -1;
+    const uint64_t executed = run_input(&run, &input);
+    printf("%s: %llu instructions, %llu frames, %u edges\n", path, (unsigned long long)executed,
+           (unsigned long long)run.chip8.frame, run.ntouched);
+    print_fault(&run.chip8, stdout);
+    release_run(&run);
+    return 0;
+}
@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Golden framebuffer tests (make test): small test ROMs, each covering a group of opcodes the
+// way the public test ROMs do, run headless for a fixed number of frames on every engine. At
+// each checkpoint the display hash (hash_display) is compared against the golden value
+// recorded below from the decode engine, the reference. Every engine must draw exactly the
+// same frames, so a cache, a block chain or the JIT getting an instruction wrong shows up as a
+// mismatch at the first checkpoint after it. The one exception is timing: the block engines
+// run whole blocks and carry what a block ran past the frame into the next one, so a
+// checkpoint in the middle of a drawing sequence may find them a block ahead. Such
+// checkpoints also record what the block engines draw; where blocks end depends on the build
+// (a CHECKED build ends them at every instruction that can fault), so the block engine and
+// the JIT may match either. Nothing is read from disk and the whole suite runs in well under
+// a second.
+//
+// The ROMs that check results in registers or RAM dump them to the screen: the dump routine
+// draws VA bytes from I as one row sprites, in 32 row columns from VB, VC. A new test starts
+// with goldens of 0, the suite then prints the hashes it gets to record.
+
+#define GOLDEN_IPS 600      // Fixed rate for flat timing, the goldens depend on it
+#define GOLDEN_CHECKPOINTS 4
+
+// Logo: every font digit, then a 15 row sprite
+static const uint8_t rom_logo[] = {
+    0x00, 0xE0, // 200: clear
+    0x60, 0x00, // 202: V0 = 0 (x)
+    0x61, 0x01, // 204: V1 = 1 (y)
+    0x62, 0x00, // 206: V2 = 0 (digit)
+    0xF2, 0x29, // 208: I = font(V2)
+    0xD0, 0x15, // 20A: draw 5 rows at V0, V1
+    0x70, 0x05, // 20C: V0 += 5
+    0x72, 0x01, // 20E: V2 += 1
+    0x30, 0x28, // 210: if V0 == 40 skip
+    0x12, 0x18, // 212: jump next
+    0x60, 0x00, // 214: V0 = 0
+    0x71, 0x06, // 216: V1 += 6
+    0x32, 0x10, // 218: if V2 == 16 skip
+    0x12, 0x08, // 21A: jump loop
+    0xA2, 0x26, // 21C: I = logo
+    0x6A, 0x30, // 21E: VA = 48
+    0x6B, 0x08, // 220: VB = 8
+    0xDA, 0xBF, // 222: draw 15 rows at VA, VB
+    0x12, 0x24, // 224: done
+    0x3C, 0x42, 0x81, 0xA5, 0x81, 0xA5, 0x99, 0x81, 0x42, 0x3C, 0x18, 0x18, 0x7E, 0x18, 0x24, // 226: logo, 15 rows
+};
+
+// Opcodes: loads, ALU without flags, skips, call/return and BCD, results dumped from RAM
+static const uint8_t rom_opcodes[] = {
+    0x60, 0x12, // 200: V0 = 0x12
+    0x61, 0x34, // 202: V1 = 0x34
+    0x82, 0x00, // 204: V2 = V0
+    0x72, 0x05, // 206: V2 += 5
+    0x83, 0x10, // 208: V3 = V1
+    0x83, 0x01, // 20A: V3 |= V0
+    0x64, 0x55, // 20C: V4 = 0x55
+    0x84, 0x12, // 20E: V4 &= V1
+    0x65, 0x66, // 210: V5 = 0x66
+    0x85, 0x03, // 212: V5 ^= V0
+    0x66, 0x00, // 214: V6 = 0 (skips taken as bits)
+    0x30, 0x12, // 216: if V0 == 0x12 skip
+    0x76, 0x01, // 218: V6 += 1 (skipped)
+    0x30, 0x13, // 21A: if V0 == 0x13 skip
+    0x76, 0x02, // 21C: V6 += 2
+    0x40, 0x12, // 21E: if V0 != 0x12 skip
+    0x76, 0x04, // 220: V6 += 4
+    0x40, 0x13, // 222: if V0 != 0x13 skip
+    0x76, 0x08, // 224: V6 += 8 (skipped)
+    0x67, 0x12, // 226: V7 = 0x12
+    0x50, 0x70, // 228: if V0 == V7 skip
+    0x76, 0x10, // 22A: V6 += 0x10 (skipped)
+    0x50, 0x10, // 22C: if V0 == V1 skip
+    0x76, 0x20, // 22E: V6 += 0x20
+    0x90, 0x70, // 230: if V0 != V7 skip
+    0x76, 0x40, // 232: V6 += 0x40
+    0x90, 0x10, // 234: if V0 != V1 skip
+    0x76, 0x80, // 236: V6 += 0x80 (skipped)
+    0x22, 0x54, // 238: call sub
+    0x6D, 0xFE, // 23A: VD = 254
+    0xA3, 0x10, // 23C: I = 0x310
+    0xFD, 0x33, // 23E: BCD of VD at I
+    0x6E, 0xF0, // 240: VE = 0xF0
+    0x7E, 0x20, // 242: VE += 0x20, wraps without a flag
+    0xA3, 0x00, // 244: I = 0x300
+    0xFE, 0x55, // 246: store V0..VE
+    0xA3, 0x00, // 248: I = 0x300
+    0x6A, 0x13, // 24A: VA = 19 bytes
+    0x6B, 0x00, // 24C: VB = 0
+    0x6C, 0x00, // 24E: VC = 0
+    0x22, 0x58, // 250: dump
+    0x12, 0x52, // 252: done
+    0x68, 0x77, // 254: V8 = 0x77
+    0x00, 0xEE, // 256: return
+    0x69, 0x01, // 258: V9 = 1
+    0xDB, 0xC1, // 25A: draw the byte at I as one row at VB, VC
+    0x7C, 0x01, // 25C: VC += 1
+    0x4C, 0x20, // 25E: if VC != 32 skip
+    0x22, 0x6C, // 260: next column
+    0xF9, 0x1E, // 262: I += 1
+    0x7A, 0xFF, // 264: VA -= 1
+    0x3A, 0x00, // 266: if VA == 0 skip
+    0x12, 0x5A, // 268: jump dloop
+    0x00, 0xEE, // 26A: return
+    0x6C, 0x00, // 26C: VC = 0
+    0x7B, 0x09, // 26E: VB += 9
+    0x00, 0xEE, // 270: return
+};
+
+// Flags: carry, borrow and shifted out bits in VF, VF as the destination
+static const uint8_t rom_flags[] = {
+    0x60, 0xFF, // 200: V0 = 0xFF
+    0x61, 0x01, // 202: V1 = 1
+    0x80, 0x14, // 204: V0 += V1, carry
+    0x82, 0xF0, // 206: V2 = VF
+    0x63, 0x10, // 208: V3 = 0x10
+    0x64, 0x20, // 20A: V4 = 0x20
+    0x83, 0x44, // 20C: V3 += V4, no carry
+    0x85, 0xF0, // 20E: V5 = VF
+    0x66, 0x10, // 210: V6 = 0x10
+    0x67, 0x20, // 212: V7 = 0x20
+    0x86, 0x75, // 214: V6 -= V7, borrow
+    0x88, 0xF0, // 216: V8 = VF
+    0x69, 0x20, // 218: V9 = 0x20
+    0x6A, 0x10, // 21A: VA = 0x10
+    0x8A, 0x97, // 21C: VA = V9 - VA, no borrow
+    0x8B, 0xF0, // 21E: VB = VF
+    0x6C, 0x81, // 220: VC = 0x81
+    0x8C, 0xC6, // 222: VC >>= 1, VX = VY so the same either way
+    0x8D, 0xF0, // 224: VD = VF
+    0x6E, 0x81, // 226: VE = 0x81
+    0x8E, 0xEE, // 228: VE <<= 1
+    0x6F, 0x05, // 22A: VF = 5
+    0x8F, 0x14, // 22C: VF += V1, the flag wins
+    0xA3, 0x00, // 22E: I = 0x300
+    0xFF, 0x55, // 230: store V0..VF
+    0xA3, 0x00, // 232: I = 0x300
+    0x6A, 0x10, // 234: VA = 16 bytes
+    0x6B, 0x00, // 236: VB = 0
+    0x6C, 0x00, // 238: VC = 0
+    0x22, 0x3E, // 23A: dump
+    0x12, 0x3C, // 23C: done
+    0x69, 0x01, // 23E: V9 = 1
+    0xDB, 0xC1, // 240: draw the byte at I as one row at VB, VC
+    0x7C, 0x01, // 242: VC += 1
+    0x4C, 0x20, // 244: if VC != 32 skip
+    0x22, 0x52, // 246: next column
+    0xF9, 0x1E, // 248: I += 1
+    0x7A, 0xFF, // 24A: VA -= 1
+    0x3A, 0x00, // 24C: if VA == 0 skip
+    0x12, 0x40, // 24E: jump dloop
+    0x00, 0xEE, // 250: return
+    0x6C, 0x00, // 252: VC = 0
+    0x7B, 0x09, // 254: VB += 9
+    0x00, 0xEE, // 256: return
+};
+
+// Quirks: one result per quirk, run under every profile
+static const uint8_t rom_quirks[] = {
+    0x60, 0x04, // 200: V0 = 4
+    0x62, 0x00, // 202: V2 = 0
+    0xB2, 0x06, // 204: jump jt + V0 (BNNN) or jt + V2 (BXNN)
+    0x6D, 0x01, // 206: VD = 1
+    0x12, 0x0C, // 208: jump after
+    0x6D, 0x02, // 20A: VD = 2
+    0x60, 0xF0, // 20C: V0 = 0xF0
+    0x61, 0x0F, // 20E: V1 = 0x0F
+    0x6F, 0x07, // 210: VF = 7
+    0x80, 0x11, // 212: V0 |= V1, VF reset or kept
+    0x82, 0xF0, // 214: V2 = VF
+    0x63, 0x81, // 216: V3 = 0x81
+    0x64, 0x02, // 218: V4 = 2
+    0x83, 0x46, // 21A: V3 = V4 >> 1 or V3 >>= 1
+    0x85, 0xF0, // 21C: V5 = VF
+    0xA3, 0x30, // 21E: I = 0x330
+    0xFD, 0x55, // 220: store V0..VD, I moves per quirk
+    0x60, 0x77, // 222: V0 = 0x77
+    0xF0, 0x55, // 224: mark where I was left
+    0xA3, 0x30, // 226: I = 0x330
+    0x6A, 0x10, // 228: VA = 16 bytes
+    0x6B, 0x00, // 22A: VB = 0
+    0x6C, 0x00, // 22C: VC = 0
+    0x22, 0x3C, // 22E: dump
+    0x62, 0x08, // 230: V2 = 8
+    0xF2, 0x29, // 232: I = font(V2)
+    0x60, 0x3C, // 234: V0 = 60
+    0x61, 0x1C, // 236: V1 = 28
+    0xD0, 0x15, // 238: draw past the corner, clipped or wrapped
+    0x12, 0x3A, // 23A: done
+    0x69, 0x01, // 23C: V9 = 1
+    0xDB, 0xC1, // 23E: draw the byte at I as one row at VB, VC
+    0x7C, 0x01, // 240: VC += 1
+    0x4C, 0x20, // 242: if VC != 32 skip
+    0x22, 0x50, // 244: next column
+    0xF9, 0x1E, // 246: I += 1
+    0x7A, 0xFF, // 248: VA -= 1
+    0x3A, 0x00, // 24A: if VA == 0 skip
+    0x12, 0x3E, // 24C: jump dloop
+    0x00, 0xEE, // 24E: return
+    0x6C, 0x00, // 250: VC = 0
+    0x7B, 0x09, // 252: VB += 9
+    0x00, 0xEE, // 254: return
+};
+
+// Timers and random: a dot at a random place every time the delay timer runs out
+static const uint8_t rom_timers[] = {
+    0x60, 0x0C, // 200: V0 = 12
+    0xF0, 0x15, // 202: delay = V0
+    0x60, 0x03, // 204: V0 = 3
+    0xF0, 0x18, // 206: sound = V0
+    0xF1, 0x07, // 208: V1 = delay
+    0x31, 0x00, // 20A: if V1 == 0 skip
+    0x12, 0x08, // 20C: jump wait
+    0xC3, 0x3F, // 20E: V3 = random & 63
+    0xC4, 0x1F, // 210: V4 = random & 31
+    0xA2, 0x26, // 212: I = dot
+    0xD3, 0x41, // 214: draw at V3, V4
+    0x65, 0x38, // 216: V5 = 56
+    0x66, 0x00, // 218: V6 = 0
+    0xF2, 0x29, // 21A: I = font(V2)
+    0xD5, 0x65, // 21C: erase the count
+    0x72, 0x01, // 21E: V2 += 1
+    0xF2, 0x29, // 220: I = font(V2)
+    0xD5, 0x65, // 222: draw the count
+    0x12, 0x00, // 224: jump start
+    0x80, // 226: one pixel
+};
+
+// SUPER-CHIP: hires, big font, 16x16 sprites, scrolling and flag registers
+static const uint8_t rom_schip[] = {
+    0x00, 0xFF, // 200: hires
+    0x60, 0x05, // 202: V0 = 5
+    0xF0, 0x30, // 204: I = big font(V0)
+    0x6A, 0x10, // 206: VA = 16
+    0x6B, 0x08, // 208: VB = 8
+    0xDA, 0xBA, // 20A: draw 10 rows
+    0xA2, 0x3C, // 20C: I = spr
+    0x6A, 0x40, // 20E: VA = 64
+    0x6B, 0x10, // 210: VB = 16
+    0xDA, 0xB0, // 212: draw 16x16
+    0x00, 0xC4, // 214: scroll down 4
+    0x00, 0xFB, // 216: scroll right 4
+    0x00, 0xFC, // 218: scroll left 4
+    0x00, 0xFB, // 21A: scroll right 4
+    0x60, 0x11, // 21C: V0 = 0x11
+    0x61, 0x22, // 21E: V1 = 0x22
+    0x62, 0x33, // 220: V2 = 0x33
+    0xF2, 0x75, // 222: save V0..V2 to the flags
+    0x60, 0x00, // 224: V0 = 0
+    0x61, 0x00, // 226: V1 = 0
+    0x62, 0x00, // 228: V2 = 0
+    0xF2, 0x85, // 22A: load V0..V2 from the flags
+    0xA3, 0x00, // 22C: I = 0x300
+    0xF2, 0x55, // 22E: store V0..V2
+    0xA3, 0x00, // 230: I = 0x300
+    0x6A, 0x03, // 232: VA = 3 bytes
+    0x6B, 0x60, // 234: VB = 96
+    0x6C, 0x28, // 236: VC = 40
+    0x22, 0x5C, // 238: dump
+    0x12, 0x3A, // 23A: done
+    0xFF, 0xFF, 0xC0, 0x03, 0xA0, 0x05, 0x90, 0x09, 0x88, 0x11, 0x84, 0x21, 0x82, 0x41, 0x81, 0x81, // 23C: 16x16 frame with diagonals
+    0x81, 0x81, 0x82, 0x41, 0x84, 0x21, 0x88, 0x11, 0x90, 0x09, 0xA0, 0x05, 0xC0, 0x03, 0xFF, 0xFF, // 24C
+    0x69, 0x01, // 25C: V9 = 1
+    0xDB, 0xC1, // 25E: draw the byte at I as one row at VB, VC
+    0x7C, 0x01, // 260: VC += 1
+    0x4C, 0x20, // 262: if VC != 32 skip
+    0x22, 0x70, // 264: next column
+    0xF9, 0x1E, // 266: I += 1
+    0x7A, 0xFF, // 268: VA -= 1
+    0x3A, 0x00, // 26A: if VA == 0 skip
+    0x12, 0x5E, // 26C: jump dloop
+    0x00, 0xEE, // 26E: return
+    0x6C, 0x00, // 270: VC = 0
+    0x7B, 0x09, // 272: VB += 9
+    0x00, 0xEE, // 274: return
+};
+
+// XO-CHIP: long I, register ranges, planes, scrolling up and the audio pattern
+static const uint8_t rom_xochip[] = {
+    0xF0, 0x00, // 200: I = next word
+    0x10, 0x00, // 202: 0x1000
+    0x60, 0x11, // 204: V0 = 0x11
+    0x61, 0x22, // 206: V1 = 0x22
+    0x62, 0x33, // 208: V2 = 0x33
+    0x50, 0x22, // 20A: store V0..V2
+    0x60, 0x00, // 20C: V0 = 0
+    0x61, 0x00, // 20E: V1 = 0
+    0x62, 0x00, // 210: V2 = 0
+    0x50, 0x23, // 212: load V0..V2
+    0xF0, 0x02, // 214: audio pattern from I
+    0xF2, 0x01, // 216: plane 2
+    0xA2, 0x3C, // 218: I = spr
+    0x6A, 0x08, // 21A: VA = 8
+    0x6B, 0x08, // 21C: VB = 8
+    0xDA, 0xB8, // 21E: draw 8 rows
+    0xF3, 0x01, // 220: planes 1 and 2
+    0xF0, 0x29, // 222: I = font(V0)
+    0x6A, 0x0C, // 224: VA = 12
+    0x6B, 0x0A, // 226: VB = 10
+    0xDA, 0xB5, // 228: draw 5 rows in both planes
+    0xF1, 0x01, // 22A: plane 1
+    0x00, 0xD3, // 22C: scroll plane 1 up 3
+    0xF0, 0x00, // 22E: I = next word
+    0x10, 0x00, // 230: 0x1000
+    0x6A, 0x03, // 232: VA = 3 bytes
+    0x6B, 0x30, // 234: VB = 48
+    0x6C, 0x00, // 236: VC = 0
+    0x22, 0x44, // 238: dump
+    0x12, 0x3A, // 23A: done
+    0xFF, 0x81, 0xBD, 0xA5, 0xA5, 0xBD, 0x81, 0xFF, // 23C: 8x8 box
+    0x69, 0x01, // 244: V9 = 1
+    0xDB, 0xC1, // 246: draw the byte at I as one row at VB, VC
+    0x7C, 0x01, // 248: VC += 1
+    0x4C, 0x20, // 24A: if VC != 32 skip
+    0x22, 0x58, // 24C: next column
+    0xF9, 0x1E, // 24E: I += 1
+    0x7A, 0xFF, // 250: VA -= 1
+    0x3A, 0x00, // 252: if VA == 0 skip
+    0x12, 0x46, // 254: jump dloop
+    0x00, 0xEE, // 256: return
+    0x6C, 0x00, // 258: VC = 0
+    0x7B, 0x09, // 25A: VB += 9
+    0x00, 0xEE, // 25C: return
+};
+
+typedef struct
+{
+    uint64_t frame; // 0 ends the list
+    uint64_t hash;
+} checkpoint_t;
+
+typedef struct
+{
+    const char *name;
+    const uint8_t *data;
+    size_t size;
+    extension_t extension;
+    int quirks; // quirk_profile_t, -1 = the machine's own
+    timing_t timing;
+    checkpoint_t checkpoints[GOLDEN_CHECKPOINTS];
+} golden_test_t;
+
+static const golden_test_t golden_tests[] = {
+    {"logo", rom_logo, sizeof rom_logo, EXT_CHIP8, -1, TIMING_FLAT, {{1, 0xADBFEBD3A48F10B5ULL}, {60, 0xF056AE7117C86E06ULL}}},
+    {"opcodes", rom_opcodes, sizeof rom_opcodes, EXT_CHIP8, -1, TIMING_FLAT, {{60, 0x42AF830AA067914CULL}}},
+    {"flags", rom_flags, sizeof rom_flags, EXT_CHIP8, -1, TIMING_FLAT, {{60, 0x51CA0B8B764F6737ULL}}},
+    {"quirks-vip", rom_quirks, sizeof rom_quirks, EXT_CHIP8, QUIRKS_VIP, TIMING_FLAT, {{60, 0x2CBF5FD98E3D32E3ULL}}},
+    {"quirks-chip48", rom_quirks, sizeof rom_quirks, EXT_CHIP8, QUIRKS_CHIP48, TIMING_FLAT, {{60, 0x1130A198DB3A5506ULL}}},
+    {"quirks-schip", rom_quirks, sizeof rom_quirks, EXT_CHIP8, QUIRKS_SCHIP, TIMING_FLAT, {{60, 0xAD182B1E5C6999B8ULL}}},
+    {"quirks-xochip", rom_quirks, sizeof rom_quirks, EXT_CHIP8, QUIRKS_XOCHIP, TIMING_FLAT, {{60, 0x69D81F6440ECB31DULL}}},
+    {"timers", rom_timers, sizeof rom_timers, EXT_CHIP8, -1, TIMING_FLAT,
+     {{10, 0xD80AC658736BB725ULL}, {40, 0xBA5E74E89CB86BB2ULL}, {135, 0x3487294F66A59AB8ULL}, {600, 0x81CAD8757F9DA785ULL}}},
+    {"logo-vip", rom_logo, sizeof rom_logo, EXT_CHIP8, -1, TIMING_VIP,
+     {{1, 0xD80AC658736BB725ULL}, {8, 0x6B8594749A5E6A11ULL}, {30, 0xF056AE7117C86E06ULL}}},
+    {"timers-vip", rom_timers, sizeof rom_timers, EXT_CHIP8, -1, TIMING_VIP,
+     {{10, 0xD80AC658736BB725ULL}, {40, 0x13884D6273C0A075ULL}, {135, 0x222556E52B56647CULL}, {600, 0xE29FA2487B642C6EULL}}},
+    {"schip", rom_schip, sizeof rom_schip, EXT_SCHIP, -1, TIMING_FLAT, {{1, 0xF2BCFC8391361BE1ULL}, {60, 0x65295138A7D71F7DULL}}},
+    {"xochip", rom_xochip, sizeof rom_xochip, EXT_XOCHIP, -1, TIMING_FLAT, {{1, 0x7DA144B97D054B25ULL}, {60, 0x4C1CD383F1843856ULL}}},
+};
+
+// Checkpoints where the block engines, a block ahead, draw something else: what they draw
+static const struct
+{
+    const char *test;
+    uint64_t frame;
+    uint64_t hash;
+} block_goldens[] = {
+    // One digit a frame, the first drawn by the block the clear starts: a frame ahead throughout
+    {"logo-vip", 1, 0xADBFEBD3A48F10B5ULL},
+    {"logo-vip", 8, 0x43B9A6CD1AB6B031ULL},
+    {"xochip", 1, 0x03B04F4CA4CA4DA5ULL},   // The box, drawn by the block the first frame ends in
+};
+
+// Does a hash match the golden of a checkpoint, for an engine
+static bool matches_golden(const golden_test_t *test, const checkpoint_t *check, engine_t engine, uint64_t hash)
+{
+    if (hash == check->hash)
+        return true;
+    if (engine != ENGINE_BLOCK && engine != ENGINE_JIT)
+        return false;
+    for (size_t i = 0; i < sizeof block_goldens / sizeof block_goldens[0]; i++)
+    {
+        if (!strcmp(block_goldens[i].test, test->name) && block_goldens[i].frame == check->frame)
+            return hash == block_goldens[i].hash;
+    }
+    return false;
+}
+
+static const char *engine_names[] = {
+    [ENGINE_DECODE] = "decode",
+    [ENGINE_CACHED] = "cached",
+    [ENGINE_BLOCK] = "block",
+    [ENGINE_JIT] = "jit",
+};
+
+#ifdef JIT
+#define LAST_ENGINE ENGINE_JIT
+#else
+#define LAST_ENGINE ENGINE_BLOCK
+#endif
+
+// Run one test on one engine, checkpoint by checkpoint. False at the first mismatch
+static bool run_golden(const golden_test_t *test, config_t config, chip8_t *chip8)
+{
+    config.current_extension = test->extension;
+    config.quirk_profile = test->quirks < 0 ? default_quirk_profiles[test->extension] : (quirk_profile_t)test->quirks;
+    config.quirks = quirk_profiles[config.quirk_profile];
+    config.instructions_per_second = GOLDEN_IPS;
+    config.timing = test->timing;
+
+    release_chip8(chip8);
+    memset(chip8, 0, sizeof *chip8);
+    if (!init_chip8_from_memory(chip8, &config, test->data, test->size, (char *)test->name))
+        return false;
+
+    bool ok = true;
+    for (int i = 0; i < GOLDEN_CHECKPOINTS && test->checkpoints[i].frame; i++)
+    {
+        const checkpoint_t *check = &test->checkpoints[i];
+        while (chip8->frame < check->frame && chip8->state == RUNNING)
+            emulate_frame(chip8, &config);
+        if (chip8->state != RUNNING)
+        {
+            printf("%-16s %-6s FAIL stopped at frame %llu\n", test->name, engine_names[config.engine],
+                   (unsigned long long)chip8->frame);
+            print_fault(chip8, stdout);
+            return false;
+        }
+
+        const uint64_t hash = hash_display(chip8);
+        if (!check->hash)
+        {
+            printf("%-16s %-6s frame %llu: no golden, got 0x%016llX\n", test->name, engine_names[config.engine],
+                   (unsigned long long)check->frame, (unsigned long long)hash);
+            ok = false;
+        }
+        else if (!matches_golden(test, check, config.engine, hash))
+        {
+            printf("%-16s %-6s FAIL frame %llu: hash 0x%016llX, golden 0x%016llX\n", test->name,
+                   engine_names[config.engine], (unsigned long long)check->frame, (unsigned long long)hash,
+                   (unsigned long long)check->hash);
+            return false;
+        }
+    }
+    return ok;
+}
+
+// Every test on every engine this build has. 0 if all of them match their goldens
+int run_golden_tests(const config_t *config)
+{
+    static chip8_t chip8;
+    const int ntests = sizeof golden_tests / sizeof golden_tests[0];
+    int failed = 0;
+    for (int t = 0; t < ntests; t++)
+    {
+        bool ok = true;
+        for (engine_t engine = ENGINE_DECODE; engine <= LAST_ENGINE; engine++)
+        {
+            config_t engine_config = *config;
+            engine_config.engine = engine;
+            ok &= run_golden(&golden_tests[t], engine_config, &chip8);
+        }
+        if (ok)
+            printf("%-16s ok\n", golden_tests[t].name);
+        failed += !ok;
+    }
+    release_chip8(&chip8);
+
+    printf("%d of %d tests passed on engines decode..%s\n", ntests - failed, ntests, engine_names[LAST_ENGINE]);
+    return failed ? 1 : 0;
+}
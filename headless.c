@@ -0,0 +1,1028 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chip8.h"
+
+// Headless runner: no window, no input.
+// Runs a ROM for a fixed number of instructions or frames as fast as the host allows
+// (or paced at 60hz with --realtime), or benchmarks the interpreter loop against a set of reference ROMs.
+
+typedef struct
+{
+    const char *name;
+    const uint8_t *data;
+    size_t size;
+} reference_rom_t;
+
+// Arithmetic loop, exercises the 8XYN ALU ops and a jump
+static const uint8_t rom_alu[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x03, // 202: V1 = 3
+    0x62, 0x07, // 204: V2 = 7
+    0x80, 0x14, // 206: V0 += V1
+    0x81, 0x25, // 208: V1 -= V2
+    0x82, 0x06, // 20A: V2 >>= 1
+    0x72, 0x55, // 20C: V2 += 0x55
+    0x83, 0x03, // 20E: V3 ^= V0
+    0x84, 0x31, // 210: V4 |= V3
+    0x85, 0x42, // 212: V5 &= V4
+    0x8E, 0x0E, // 214: VE <<= 1
+    0x12, 0x06, // 216: jump 206
+};
+
+// Draw loop, blits every font glyph across the screen
+static const uint8_t rom_draw[] = {
+    0x60, 0x00, // 200: V0 = 0 (x)
+    0x61, 0x00, // 202: V1 = 0 (y)
+    0x62, 0x00, // 204: V2 = 0 (glyph)
+    0xF2, 0x29, // 206: I = font(V2)
+    0xD0, 0x15, // 208: draw 5 rows at V0, V1
+    0x70, 0x05, // 20A: V0 += 5
+    0x71, 0x03, // 20C: V1 += 3
+    0x72, 0x01, // 20E: V2 += 1
+    0x42, 0x10, // 210: if V2 != 16 skip
+    0x62, 0x00, // 212: V2 = 0
+    0x12, 0x06, // 214: jump 206
+};
+
+// Subroutine loop, exercises call/return and the BCD/register load memory ops
+static const uint8_t rom_calls[] = {
+    0x65, 0x00, // 200: V5 = 0
+    0x22, 0x08, // 202: call 208
+    0x75, 0x01, // 204: V5 += 1
+    0x12, 0x02, // 206: jump 202
+    0xA3, 0x00, // 208: I = 0x300
+    0xF5, 0x33, // 20A: BCD of V5 at I
+    0xA3, 0x00, // 20C: I = 0x300
+    0xF2, 0x65, // 20E: load V0 - V2 from I
+    0x30, 0x09, // 210: if V0 == 9 skip
+    0x80, 0x24, // 212: V0 += V2
+    0x00, 0xEE, // 214: return
+};
+
+static const reference_rom_t reference_roms[] = {
+    {"alu", rom_alu, sizeof rom_alu},
+    {"draw", rom_draw, sizeof rom_draw},
+    {"calls", rom_calls, sizeof rom_calls},
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s <rom_name> [--instructions N | --frames N [--realtime]] [--engine decode|cached|block|jit] [--ips N] [--seed N]\n", prog);
+    printf("       %s <rom_name> ... [--extension chip8|schip|xochip] [--quirks vip|chip48|schip|xochip]  (every mode takes them)\n", prog);
+    printf("       %s <rom_name> --frames N ... --timing vip  (COSMAC VIP cycles per instruction instead of --ips)\n", prog);
+    printf("       %s <rom_name> --frames N [--snapshots file] [--resume file] [--rewind frames]\n", prog);
+    printf("       %s <rom_name> --replay input_log [--frames N]\n", prog);
+    printf("       %s <rom_name> ... --trace file  (last instructions, read with chip8-trace)\n", prog);
+    printf("       %s <rom_name> --frames N [--realtime] --audio file.wav|null  (sound, see audio.c)\n", prog);
+    printf("       %s <rom_name> --frames N [--break addr] [--watch addr] [--watch-i] [--run-to frame]\n", prog);
+    printf("       %s <rom_name> --frames N [--realtime] --debug-server socket_path  (see debugserver.c)\n", prog);
+    printf("       %s --bench [--instructions N] [--ips N] [rom_name ...]\n", prog);
+    printf("       %s --batch [--threads N] [--instructions N | --frames N] [--seed N] rom_name ...\n", prog);
+    printf("       %s --fuzz out_dir [--threads N] [--seconds N] [--instructions N] seed_rom ...  (see fuzz.c)\n", prog);
+    printf("       %s <rom_name> --fuzz-run [--instructions N]  (one run as the fuzzer does it)\n", prog);
+    printf("       %s --jit-diff [--instructions N] [rom_name ...]  (JIT builds)\n", prog);
+    printf("       %s --test  (golden framebuffer tests on every engine, see golden.c)\n", prog);
+    printf("       %s <rom_name> ... [--profile file.json]  (profiling builds, report on exit)\n", prog);
+}
+
+// Snapshot chains: a complete save state, then one delta per frame, each record prefixed
+// by its u32 little endian size
+static bool write_snapshot(FILE *out, const chip8_t *chip8, snapshot_t *snap, uint64_t *bytes)
+{
+    uint8_t state[SAVESTATE_MAX_SIZE];
+    const size_t size = save_state(chip8, snap, state, sizeof state);
+    const uint8_t header[4] = {size, size >> 8, size >> 16, size >> 24};
+    *bytes += sizeof header + size;
+    return fwrite(header, sizeof header, 1, out) == 1 && fwrite(state, size, 1, out) == 1;
+}
+
+// Load every state of a chain, leaving the machine at the last one
+static bool resume_snapshots(chip8_t *chip8, const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        printf("Could not open snapshots %s\n", path);
+        return false;
+    }
+    static snapshot_t snap;
+    uint8_t state[SAVESTATE_MAX_SIZE];
+    uint8_t header[4];
+    uint64_t loaded = 0;
+    bool ok = true;
+    while (ok && fread(header, sizeof header, 1, in) == 1)
+    {
+        const size_t size = header[0] | header[1] << 8 | header[2] << 16 | (size_t)header[3] << 24;
+        if (size > sizeof state || fread(state, size, 1, in) != 1)
+            break; // Torn last record, the writer died mid-snapshot
+        ok = load_state(chip8, &snap, state, size);
+        loaded += ok;
+    }
+    fclose(in);
+    if (!ok || !loaded)
+        printf("Snapshots %s are unreadable after %llu states\n", path, (unsigned long long)loaded);
+    else
+        printf("resumed at frame %llu from %llu states\n", (unsigned long long)chip8->frame, (unsigned long long)loaded);
+    return ok && loaded;
+}
+
+// Answer the debug server between frames. While the machine is stopped, wait here for the
+// client to continue it; the emulation thread never blocks on the server itself
+static void serve_debugger(chip8_t *chip8, const config_t *config, debug_server_t *server)
+{
+    poll_debug_server(server, chip8, config);
+    while (chip8->debug->stopped && chip8->state != QUIT)
+    {
+        const struct timespec wait = {.tv_nsec = 1000000};
+        nanosleep(&wait, NULL);
+        poll_debug_server(server, chip8, config);
+    }
+}
+
+// Run frames as fast as possible, optionally replaying an input log into the keypad
+// and snapshotting the machine after each frame. With a debugger attached every stop is
+// printed; the debug server's client continues the machine, otherwise it continues at once.
+// With an audio sink each frame's sound is rendered into it as soon as the frame ends
+static uint64_t run_frames(chip8_t *chip8, const config_t *config, uint64_t frames, FILE *snapshots,
+                           input_log_t *replay, debug_server_t *server, audio_sink_t *sink)
+{
+    static snapshot_t snap;
+    uint64_t executed = 0;
+    uint64_t bytes = 0;
+    uint64_t taken = 0;
+    uint64_t stops = 0;
+    if (snapshots && write_snapshot(snapshots, chip8, &snap, &bytes))
+        taken++;
+    while (chip8->frame < frames && chip8->state != QUIT)
+    {
+        if (server)
+            serve_debugger(chip8, config, server);
+        if (replay && !replay_input(replay, chip8))
+            break;
+        executed += emulate_frame(chip8, config);
+        if (sink)
+            drain_audio(chip8->audio, sink);
+        if (chip8->debug && chip8->debug->stopped)
+        {
+            print_debug_stop(chip8, stdout);
+            stops++;
+            if (chip8->frame == frames || server)
+                continue; // Stopped right at the end, or held for the client
+            debug_continue(chip8, config);
+            executed++; // The instruction it stopped on
+            continue;
+        }
+        if (snapshots && write_snapshot(snapshots, chip8, &snap, &bytes))
+            taken++;
+    }
+    if (chip8->debug)
+        printf("debugger stops: %llu\n", (unsigned long long)stops);
+    if (snapshots)
+        printf("snapshots: %llu, %llu bytes (%.1f per snapshot)\n", (unsigned long long)taken,
+               (unsigned long long)bytes, taken ? (double)bytes / taken : 0.0);
+    return executed;
+}
+
+// Run frames recording rewind history, then step back the given number of frames
+static uint64_t run_rewind(chip8_t *chip8, const config_t *config, uint64_t frames, uint64_t steps)
+{
+    static rewind_t rw;
+    uint64_t executed = 0;
+    if (!init_rewind(&rw, REWIND_SECONDS * FRAME_RATE, REWIND_BYTES))
+        return 0;
+    rewind_record(&rw, chip8);
+    while (chip8->frame < frames && chip8->state != QUIT)
+    {
+        executed += emulate_frame(chip8, config);
+        rewind_record(&rw, chip8);
+    }
+    const size_t used = rewind_used(&rw);
+    const uint32_t held = rw.count;
+
+    const uint64_t start = now_ns();
+    uint64_t stepped = 0;
+    while (stepped < steps && rewind_step(&rw, chip8))
+        stepped++;
+    const uint64_t elapsed = now_ns() - start;
+
+    printf("rewind: %u frames held in %zu bytes, stepped back %llu frames, %.1f us per step\n", held, used,
+           (unsigned long long)stepped, stepped ? elapsed / 1e3 / stepped : 0.0);
+    release_rewind(&rw);
+    return executed;
+}
+
+// Run frames on the fixed-timestep scheduler, sleeping on absolute deadlines between them
+static uint64_t run_realtime(chip8_t *chip8, const config_t *config, uint64_t frames, debug_server_t *server,
+                             audio_sink_t *sink)
+{
+    scheduler_t sched;
+    uint64_t executed = 0;
+    init_scheduler(&sched, now_ns());
+    while (chip8->frame < frames && chip8->state != QUIT)
+    {
+        if (server && (poll_debug_server(server, chip8, config), chip8->debug->stopped))
+        {
+            serve_debugger(chip8, config, server);
+            init_scheduler(&sched, now_ns()); // Resume without a catch-up burst
+        }
+        for (uint32_t due = scheduler_due(&sched, now_ns()); due && chip8->frame < frames; due--)
+        {
+            executed += emulate_frame(chip8, config);
+            if (sink)
+                drain_audio(chip8->audio, sink);
+            if (chip8->debug && chip8->debug->stopped)
+            {
+                print_debug_stop(chip8, stdout);
+                break;
+            }
+        }
+        if (chip8->frame == frames)
+            break;
+
+        const uint64_t next = scheduler_next_ns(&sched);
+        const struct timespec deadline = {.tv_sec = next / 1000000000ULL, .tv_nsec = next % 1000000000ULL};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+            ;
+    }
+    if (sched.dropped)
+        printf("dropped frames: %llu\n", (unsigned long long)sched.dropped);
+    return executed;
+}
+
+// Run a machine for a fixed instruction count, timers tick every instructions_per_second / 60.
+// The block engines finish their last block, so a few more may run
+static uint64_t run_instructions(chip8_t *chip8, const config_t *config, uint64_t count)
+{
+    const uint32_t per_frame = config->instructions_per_second / 60;
+    uint64_t executed = 0;
+    uint32_t done = 0; // Into the current frame
+    while (executed < count)
+    {
+        const uint64_t left = count - executed;
+        const uint32_t batch = left < per_frame - done ? left : per_frame - done;
+        const uint32_t ran = emulate_instructions(chip8, config, batch);
+        executed += ran;
+        for (done += ran; done >= per_frame; done -= per_frame)
+            update_timers(chip8);
+    }
+    return executed;
+}
+
+static const char *engine_names[] = {
+    [ENGINE_DECODE] = "decode",
+    [ENGINE_CACHED] = "cached",
+    [ENGINE_BLOCK] = "block",
+    [ENGINE_JIT] = "jit",
+};
+
+#ifdef JIT
+#define LAST_ENGINE ENGINE_JIT
+#else
+#define LAST_ENGINE ENGINE_BLOCK
+#endif
+
+static void bench_one(const char *name, chip8_t *chip8, const config_t *config, uint64_t count)
+{
+    const uint64_t start = now_ns();
+    const uint64_t executed = run_instructions(chip8, config, count);
+    const uint64_t elapsed = now_ns() - start;
+
+    const double seconds = elapsed / 1e9;
+    printf("%-16s %-8s %12llu %10.3f %14.0f %10.2f  %016llx\n",
+           name, engine_names[config->engine], (unsigned long long)executed, seconds,
+           seconds > 0 ? executed / seconds : 0.0,
+           executed ? (double)elapsed / executed : 0.0,
+           (unsigned long long)hash_display(chip8));
+}
+
+// Run one ROM image once per engine, from a fresh machine each time
+static bool bench_rom(const char *name, const uint8_t *data, size_t size, config_t config, uint64_t count)
+{
+    static chip8_t chip8;
+    for (engine_t engine = ENGINE_DECODE; engine <= LAST_ENGINE; engine++)
+    {
+        release_chip8(&chip8);
+        memset(&chip8, 0, sizeof chip8);
+        if (!init_chip8_from_memory(&chip8, &config, data, size, (char *)name))
+            return false;
+        config.engine = engine;
+        bench_one(name, &chip8, &config, count);
+    }
+    return true;
+}
+
+#ifdef JIT
+// Full architectural state, everything an engine is allowed to change
+static bool same_state(const chip8_t *a, const chip8_t *b)
+{
+    return a->stack_depth == b->stack_depth &&
+           !memcmp(a->stack, b->stack, a->stack_depth * sizeof a->stack[0]) &&
+           !memcmp(a->ram, b->ram, sizeof a->ram) &&
+           !memcmp(a->display, b->display, sizeof a->display) &&
+           !memcmp(a->V, b->V, sizeof a->V) &&
+           a->I == b->I && a->PC == b->PC &&
+           a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer &&
+           a->dirty_rows == b->dirty_rows && a->rng == b->rng &&
+           a->hires == b->hires && a->planes == b->planes && !memcmp(a->rpl, b->rpl, sizeof a->rpl) &&
+           a->pitch == b->pitch && !memcmp(a->pattern, b->pattern, sizeof a->pattern);
+}
+
+// Run the JIT and the cached interpreter in lockstep, comparing the machines after every block
+static bool jit_diff_rom(const char *name, const uint8_t *data, size_t size, config_t config, uint64_t count)
+{
+    static chip8_t jit, ref;
+    release_chip8(&jit);
+    memset(&jit, 0, sizeof jit);
+    memset(&ref, 0, sizeof ref);
+    if (!init_chip8_from_memory(&jit, &config, data, size, (char *)name) ||
+        !init_chip8_from_memory(&ref, &config, data, size, (char *)name))
+        return false;
+
+    config_t jit_config = config;
+    config_t ref_config = config;
+    jit_config.engine = ENGINE_JIT;
+    ref_config.engine = ENGINE_CACHED;
+
+    const uint32_t per_frame = config.instructions_per_second / 60;
+    uint32_t frame_left = per_frame;
+    uint64_t executed = 0;
+    uint64_t blocks = 0;
+    while (executed < count)
+    {
+        const uint16_t pc = jit.PC;
+        const uint32_t n = emulate_block(&jit, &jit_config);
+        emulate_instructions(&ref, &ref_config, n);
+        blocks++;
+        executed += n;
+
+        if (!same_state(&jit, &ref))
+        {
+            printf("%-16s FAIL after block %llu at 0x%03X (%u instructions): PC %03X/%03X I %03X/%03X\n",
+                   name, (unsigned long long)blocks, pc, n, jit.PC, ref.PC, jit.I, ref.I);
+            for (int v = 0; v < 16; v++)
+            {
+                if (jit.V[v] != ref.V[v])
+                    printf("    V%X jit %02X interpreter %02X\n", v, jit.V[v], ref.V[v]);
+            }
+            return false;
+        }
+
+        if (n >= frame_left)
+        {
+            update_timers(&jit);
+            update_timers(&ref);
+            frame_left = per_frame;
+        }
+        else
+            frame_left -= n;
+    }
+
+    printf("%-16s ok, %llu blocks, %llu instructions\n", name, (unsigned long long)blocks, (unsigned long long)executed);
+    return true;
+}
+#endif
+
+static bool read_rom(const char *rom_name, uint8_t *data, size_t *size)
+{
+    FILE *rom = fopen(rom_name, "rb");
+    if (!rom)
+    {
+        printf("Could not open ROM FILE: %s\n", rom_name);
+        return false;
+    }
+    *size = fread(data, 1, XO_RAM_SIZE, rom);
+    fclose(rom);
+    return true;
+}
+
+#ifdef JIT
+static int jit_diff(config_t config, uint64_t count, int nroms, char **roms)
+{
+    bool ok = true;
+    for (size_t i = 0; i < sizeof reference_roms / sizeof reference_roms[0]; i++)
+        ok &= jit_diff_rom(reference_roms[i].name, reference_roms[i].data, reference_roms[i].size, config, count);
+
+    for (int i = 0; i < nroms; i++)
+    {
+        uint8_t data[XO_RAM_SIZE];
+        size_t size;
+        ok &= read_rom(roms[i], data, &size) && jit_diff_rom(roms[i], data, size, config, count);
+    }
+    return ok ? 0 : 1;
+}
+#endif
+
+// Frame handoff to the renderer: the old by-value signature against the framebuffer view.
+// Both sinks fold the dirty rows so the compiler has to materialize their argument
+__attribute__((noinline)) static uint64_t present_by_value(config_t config, chip8_t chip8)
+{
+    uint64_t sum = config.fg_color;
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; y++)
+        sum += chip8.display[0][0][y];
+    return sum;
+}
+
+__attribute__((noinline)) static uint64_t present_by_view(const config_t *config, framebuffer_t fb)
+{
+    uint64_t sum = config->fg_color;
+    for (uint32_t y = 0; y < fb.height; y++)
+        sum += fb.rows[0][0][y];
+    return sum;
+}
+
+static void bench_handoff(const config_t *config)
+{
+    static chip8_t chip8;
+    const uint32_t frames = 100000;
+    volatile uint64_t sink = 0;
+
+    release_chip8(&chip8);
+    memset(&chip8, 0, sizeof chip8);
+    if (!init_chip8_from_memory(&chip8, config, rom_draw, sizeof rom_draw, "handoff"))
+        return;
+
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < frames; i++)
+        sink += present_by_value(*config, chip8);
+    const uint64_t by_value = now_ns() - start;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < frames; i++)
+        sink += present_by_view(config, get_framebuffer(&chip8));
+    const uint64_t by_view = now_ns() - start;
+    (void)sink;
+
+    printf("\nframe handoff (%zu byte machine, %u frames)\n", sizeof chip8, frames);
+    printf("%-16s %10.2f ns/frame\n", "by value", (double)by_value / frames);
+    printf("%-16s %10.2f ns/frame\n", "framebuffer view", (double)by_view / frames);
+    release_chip8(&chip8);
+}
+
+// Machine startup: reading the ROM file (or copying font and program) on every start,
+// against one copy from the shared image in the ROM store
+// Start a machine from a ROM file, read each time, and from the ROM store, which reads it once
+static void bench_startup_file(chip8_t *chip8, const config_t *config, rom_store_t *store, uint32_t starts,
+                               const char *name, char *path)
+{
+    uint64_t start = now_ns();
+    for (uint32_t n = 0; n < starts; n++)
+        init_chip8(chip8, config, path);
+    const uint64_t from_file = now_ns() - start;
+
+    start = now_ns();
+    const rom_image_t *rom = rom_store_add(store, path, config->current_extension);
+    for (uint32_t n = 0; rom && n < starts; n++)
+        init_chip8_from_image(chip8, config, rom->ram, path);
+    const uint64_t from_store = now_ns() - start;
+
+    printf("%-16s file   %8.0f ns   store %8.0f ns\n", name,
+           (double)from_file / starts, (double)from_store / starts);
+}
+
+static void bench_startup(const config_t *config, int nroms, char **roms)
+{
+    static chip8_t chip8;
+    const uint32_t starts = 10000;
+    rom_store_t store = {0};
+
+    printf("\nmachine startup (%u starts each)\n", starts);
+    for (size_t i = 0; i < sizeof reference_roms / sizeof reference_roms[0]; i++)
+    {
+        const reference_rom_t *rom = &reference_roms[i];
+        uint8_t image[XO_RAM_SIZE];
+        build_ram_image(image, config->current_extension, rom->data, rom->size, rom->name);
+
+        uint64_t start = now_ns();
+        for (uint32_t n = 0; n < starts; n++)
+            init_chip8_from_memory(&chip8, config, rom->data, rom->size, (char *)rom->name);
+        const uint64_t from_memory = now_ns() - start;
+
+        start = now_ns();
+        for (uint32_t n = 0; n < starts; n++)
+            init_chip8_from_image(&chip8, config, image, (char *)rom->name);
+        const uint64_t from_image = now_ns() - start;
+
+        printf("%-16s memory %8.0f ns   image %8.0f ns\n", rom->name,
+               (double)from_memory / starts, (double)from_image / starts);
+
+        // The file rows need the ROM on disk: write it to a temporary file
+        char path[] = "/tmp/chip8-bench-XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd < 0)
+        {
+            printf("Could not create a temporary file for %s: %s\n", rom->name, strerror(errno));
+            continue;
+        }
+        const bool written = write(fd, rom->data, rom->size) == (ssize_t)rom->size;
+        close(fd);
+        if (written)
+            bench_startup_file(&chip8, config, &store, starts, rom->name, path);
+        else
+            printf("Could not write %s to %s\n", rom->name, path);
+        unlink(path);
+    }
+
+    for (int i = 0; i < nroms; i++)
+        bench_startup_file(&chip8, config, &store, starts, roms[i], roms[i]);
+    release_chip8(&chip8);
+    rom_store_release(&store);
+}
+
+static int bench(config_t config, uint64_t count, int nroms, char **roms)
+{
+    printf("%-16s %-8s %12s %10s %14s %10s  %s\n", "rom", "engine", "instructions", "seconds", "instr/s", "ns/instr", "display hash");
+
+    for (size_t i = 0; i < sizeof reference_roms / sizeof reference_roms[0]; i++)
+    {
+        if (!bench_rom(reference_roms[i].name, reference_roms[i].data, reference_roms[i].size, config, count))
+            return -1;
+    }
+
+    for (int i = 0; i < nroms; i++)
+    {
+        uint8_t data[XO_RAM_SIZE];
+        size_t size;
+        if (!read_rom(roms[i], data, &size) || !bench_rom(roms[i], data, size, config, count))
+            return -1;
+    }
+
+    bench_handoff(&config);
+    bench_startup(&config, nroms, roms);
+    return 0;
+}
+
+// Batch mode: every ROM gets its own machine, and a pool of worker threads runs them.
+// Each worker owns a queue of ROM indices. It takes work from the back of its own queue
+// and, once that is empty, steals from the front of the others' queues, so a few slow
+// ROMs do not leave the other cores idle. Results are kept per ROM and printed in command line order.
+
+typedef struct
+{
+    uint64_t hash;
+    uint64_t instructions;
+    uint64_t ns;
+    uint64_t startup_ns; // Machine initialization, part of ns
+    int worker;
+    bool ok;
+} batch_result_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    int *jobs;
+    int head; // Thieves take from here
+    int tail; // Owner takes from here
+} job_queue_t;
+
+typedef struct batch batch_t;
+
+typedef struct
+{
+    pthread_t thread;
+    job_queue_t queue;
+    chip8_t chip8; // Reused for every ROM this worker runs
+    batch_t *batch;
+    int id;
+} worker_t;
+
+struct batch
+{
+    const config_t *config;
+    char **roms;
+    const rom_image_t **images; // Shared initial RAM of each ROM, NULL if it failed to load
+    batch_result_t *results;
+    worker_t *workers;
+    int nworkers;
+    uint64_t instructions;
+    uint64_t frames;
+    uint64_t seed;
+};
+
+static bool pop_job(job_queue_t *queue, bool steal, int *job)
+{
+    pthread_mutex_lock(&queue->lock);
+    const bool found = queue->head < queue->tail;
+    if (found)
+        *job = steal ? queue->jobs[queue->head++] : queue->jobs[--queue->tail];
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Own queue first, then every other worker's in turn. All jobs are queued up front,
+// so once nothing can be stolen the batch is done
+static bool next_job(worker_t *worker, int *job)
+{
+    if (pop_job(&worker->queue, false, job))
+        return true;
+    for (int i = 1; i < worker->batch->nworkers; i++)
+    {
+        worker_t *victim = &worker->batch->workers[(worker->id + i) % worker->batch->nworkers];
+        if (pop_job(&victim->queue, true, job))
+            return true;
+    }
+    return false;
+}
+
+static void run_job(worker_t *worker, int job)
+{
+    const batch_t *batch = worker->batch;
+    chip8_t *chip8 = &worker->chip8;
+    batch_result_t *result = &batch->results[job];
+    result->worker = worker->id;
+
+    if (!batch->images[job])
+        return;
+    const uint64_t start = now_ns();
+    init_chip8_from_image(chip8, batch->config, batch->images[job]->ram, batch->roms[job]);
+    seed_chip8(chip8, batch->seed);
+    result->startup_ns = now_ns() - start;
+
+    if (batch->frames)
+    {
+        while (chip8->frame < batch->frames && chip8->state != QUIT)
+            result->instructions += emulate_frame(chip8, batch->config);
+    }
+    else
+        result->instructions = run_instructions(chip8, batch->config, batch->instructions);
+
+    result->ns = now_ns() - start;
+    result->hash = hash_display(chip8);
+    result->ok = true;
+}
+
+static void *batch_worker(void *arg)
+{
+    worker_t *worker = arg;
+    int job;
+    while (next_job(worker, &job))
+        run_job(worker, job);
+    release_chip8(&worker->chip8);
+    return NULL;
+}
+
+static int batch(const config_t *config, uint64_t instructions, uint64_t frames, uint64_t seed,
+                 int nthreads, int nroms, char **roms)
+{
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > nroms)
+        nthreads = nroms;
+
+    batch_t batch = {
+        .config = config,
+        .roms = roms,
+        .images = calloc(nroms, sizeof(rom_image_t *)),
+        .results = calloc(nroms, sizeof(batch_result_t)),
+        .workers = calloc(nthreads, sizeof(worker_t)),
+        .nworkers = nthreads,
+        .instructions = instructions,
+        .frames = frames,
+        .seed = seed,
+    };
+    int *jobs = malloc(nroms * sizeof(int));
+    if (!batch.images || !batch.results || !batch.workers || !jobs)
+    {
+        printf("Could not allocate %d machines\n", nthreads);
+        return -1;
+    }
+
+    // Every file is read once, identical ROMs share one image
+    rom_store_t store = {0};
+    const uint64_t load_start = now_ns();
+    for (int i = 0; i < nroms; i++)
+        batch.images[i] = rom_store_add(&store, roms[i], config->current_extension);
+    const uint64_t load_ns = now_ns() - load_start;
+
+    // Deal the ROMs out round robin, each worker's slice is contiguous in jobs[]
+    int next = 0;
+    for (int w = 0; w < nthreads; w++)
+    {
+        worker_t *worker = &batch.workers[w];
+        worker->queue.jobs = &jobs[next];
+        for (int job = w; job < nroms; job += nthreads)
+            jobs[next + worker->queue.tail++] = job;
+        next += worker->queue.tail;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->batch = &batch;
+        worker->id = w;
+    }
+
+    const uint64_t start = now_ns();
+    int started = 0;
+    for (; started < nthreads; started++)
+    {
+        if (pthread_create(&batch.workers[started].thread, NULL, batch_worker, &batch.workers[started]))
+            break;
+    }
+    if (!started)
+        batch_worker(&batch.workers[0]); // No threads available, run everything here
+    for (int w = 0; w < started; w++)
+        pthread_join(batch.workers[w].thread, NULL);
+    const uint64_t elapsed = now_ns() - start;
+
+    int failed = 0;
+    uint64_t total = 0;
+    uint64_t startup = 0;
+    printf("%-24s %12s %10s %6s  %s\n", "rom", "instructions", "seconds", "worker", "display hash");
+    for (int i = 0; i < nroms; i++)
+    {
+        const batch_result_t *result = &batch.results[i];
+        if (!result->ok)
+        {
+            printf("%-24s FAILED\n", roms[i]);
+            failed++;
+            continue;
+        }
+        total += result->instructions;
+        startup += result->startup_ns;
+        printf("%-24s %12llu %10.3f %6d  %016llx\n", roms[i], (unsigned long long)result->instructions,
+               result->ns / 1e9, result->worker, (unsigned long long)result->hash);
+    }
+    printf("%d roms on %d threads, %llu instructions in %.3f s (%.0f instr/s)\n",
+           nroms, started ? started : 1, (unsigned long long)total, elapsed / 1e9,
+           elapsed ? total / (elapsed / 1e9) : 0.0);
+    printf("startup: %zu unique roms stored in %.3f ms, %.2f us per machine\n", store.count, load_ns / 1e6,
+           nroms > failed ? startup / 1e3 / (nroms - failed) : 0.0);
+
+    for (int w = 0; w < nthreads; w++)
+        pthread_mutex_destroy(&batch.workers[w].queue.lock);
+    rom_store_release(&store);
+    free(jobs);
+    free(batch.workers);
+    free(batch.results);
+    free(batch.images);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    config_t config = {0};
+    if (!set_config_from_args(&config, argc, argv))
+        return -1;
+
+    bool do_bench = false;
+    bool do_jit_diff = false;
+    bool do_test = false;
+    bool realtime = false;
+    bool do_batch = false;
+    const char *fuzz_dir = NULL;
+    bool do_fuzz_run = false;
+    uint64_t seconds = 0;
+    int threads = 0;
+    uint64_t seed = 0;
+    const char *snapshots = NULL;
+    const char *resume = NULL;
+    uint64_t rewind = 0;
+    const char *replay = NULL;
+    const char *profile = NULL;
+    const char *trace_path = NULL;
+    const char *server_path = NULL;
+    const char *audio_path = NULL;
+    uint16_t breakpoints[argc], watchpoints[argc];
+    int nbreakpoints = 0, nwatchpoints = 0;
+    bool watch_i = false;
+    uint64_t run_to = 0;
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    char *roms[argc];
+    int nroms = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--bench"))
+            do_bench = true;
+        else if (!strcmp(argv[i], "--jit-diff"))
+            do_jit_diff = true;
+        else if (!strcmp(argv[i], "--test"))
+            do_test = true;
+        else if (!strcmp(argv[i], "--realtime"))
+            realtime = true;
+        else if (!strcmp(argv[i], "--batch"))
+            do_batch = true;
+        else if (!strcmp(argv[i], "--fuzz") && i + 1 < argc)
+            fuzz_dir = argv[++i];
+        else if (!strcmp(argv[i], "--fuzz-run"))
+            do_fuzz_run = true;
+        else if (!strcmp(argv[i], "--seconds") && i + 1 < argc)
+            seconds = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = strtol(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--snapshots") && i + 1 < argc)
+            snapshots = argv[++i];
+        else if (!strcmp(argv[i], "--resume") && i + 1 < argc)
+            resume = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replay = argv[++i];
+        else if (!strcmp(argv[i], "--break") && i + 1 < argc)
+            breakpoints[nbreakpoints++] = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--watch") && i + 1 < argc)
+            watchpoints[nwatchpoints++] = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--watch-i"))
+            watch_i = true;
+        else if (!strcmp(argv[i], "--run-to") && i + 1 < argc)
+            run_to = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--debug-server") && i + 1 < argc)
+            server_path = argv[++i];
+        else if (!strcmp(argv[i], "--audio") && i + 1 < argc)
+            audio_path = argv[++i];
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc)
+            profile = argv[++i];
+        else if (!strcmp(argv[i], "--rewind") && i + 1 < argc)
+            rewind = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--instructions") && i + 1 < argc)
+            instructions = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = strtoull(argv[++i], NULL, 0);
+        else if ((!strcmp(argv[i], "--engine") || !strcmp(argv[i], "--ips") || !strcmp(argv[i], "--extension") ||
+                  !strcmp(argv[i], "--quirks") || !strcmp(argv[i], "--timing")) && i + 1 < argc)
+            i++; // Handled by set_config_from_args
+        else if (!strcmp(argv[i], "--no-vsync"))
+            continue; // Window option, nothing to do headless
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return -1;
+        }
+        else
+            roms[nroms++] = argv[i];
+    }
+
+    // VIP timing paces frames; the instruction budgets (--instructions, --bench, the fuzzer)
+    // would silently run flat
+    if (config.timing == TIMING_VIP && !do_test &&
+        ((!frames && !replay) || do_bench || do_jit_diff || fuzz_dir || do_fuzz_run))
+    {
+        printf("--timing vip runs with --frames (or --replay)\n");
+        return -1;
+    }
+
+    if (do_jit_diff)
+    {
+#ifdef JIT
+        return jit_diff(config, instructions ? instructions : 1000000, nroms, roms);
+#else
+        printf("--jit-diff needs a JIT build (make headless-jit)\n");
+        return -1;
+#endif
+    }
+
+#ifndef PROFILE
+    if (profile)
+    {
+        printf("--profile needs a profiling build (make headless-profile)\n");
+        return -1;
+    }
+#endif
+
+    if (do_test)
+        return run_golden_tests(&config);
+
+    if (do_bench)
+        return bench(config, instructions ? instructions : 20000000, nroms, roms);
+
+    if (do_batch && nroms)
+        return batch(&config, instructions ? instructions : 1000000, frames, seed, threads, nroms, roms);
+
+    if (fuzz_dir && nroms)
+        return fuzz(&config, fuzz_dir, threads, seconds, instructions ? instructions : FUZZ_BUDGET, nroms, roms);
+    if (do_fuzz_run && nroms == 1)
+        return fuzz_run(&config, roms[0], instructions ? instructions : FUZZ_BUDGET);
+
+    if (nroms != 1 || do_batch || fuzz_dir || do_fuzz_run)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    static chip8_t chip8;
+    if (!init_chip8(&chip8, &config, roms[0]))
+    {
+        printf("initializaton failed\n");
+        return -1;
+    }
+    seed_chip8(&chip8, seed);
+    // A replay brings its own seed and CPU rate, and runs to the end of the log by default
+    input_log_t log = {0};
+    if (replay)
+    {
+        if (!start_replay(&log, replay, &chip8, &config))
+            return -1;
+        if (!frames)
+            frames = UINT64_MAX;
+    }
+    if (resume && !resume_snapshots(&chip8, resume))
+        return -1;
+    static debugger_t debug;
+    if (nbreakpoints || nwatchpoints || watch_i || run_to || server_path)
+    {
+        if (!frames || rewind || (realtime && !server_path))
+        {
+            printf("The debugger runs with --frames, without --rewind, and with --realtime only under --debug-server\n");
+            return -1;
+        }
+        attach_debugger(&chip8, &debug);
+        for (int i = 0; i < nbreakpoints; i++)
+            set_breakpoint(&chip8, breakpoints[i], true);
+        for (int i = 0; i < nwatchpoints; i++)
+            set_watchpoint(&chip8, watchpoints[i], true);
+        set_watch_i(&chip8, watch_i);
+        run_to_frame(&chip8, run_to);
+    }
+    debug_server_t *server = NULL;
+    if (server_path && !(server = start_debug_server(server_path)))
+        return -1;
+    trace_t trace = {0};
+    if (trace_path)
+    {
+        if (!init_trace(&trace, TRACE_ENTRIES))
+            return -1;
+        chip8.trace = &trace;
+    }
+
+    // Sound goes to a WAV file or a null sink, rendered on this thread after every frame
+    static audio_t audio;
+    audio_sink_t sink = {0};
+    if (audio_path)
+    {
+        if (!frames || rewind)
+        {
+            printf("--audio runs with --frames, without --rewind\n");
+            return -1;
+        }
+        init_audio(&audio, AUDIO_RATE);
+        if (!open_audio_sink(&sink, &audio, audio_path))
+            return -1;
+        chip8.audio = &audio;
+    }
+
+    FILE *snapshot_file = NULL;
+    if (snapshots && !(snapshot_file = fopen(snapshots, "wb")))
+    {
+        printf("Could not create snapshots %s\n", snapshots);
+        return -1;
+    }
+
+    const uint64_t start = now_ns();
+    uint64_t executed = 0;
+    if (frames && rewind)
+        executed = run_rewind(&chip8, &config, frames, rewind);
+    else if (frames && realtime)
+        executed = run_realtime(&chip8, &config, frames, server, audio_path ? &sink : NULL);
+    else if (frames)
+        executed = run_frames(&chip8, &config, frames, snapshot_file, replay ? &log : NULL, server,
+                              audio_path ? &sink : NULL);
+    else
+        executed = run_instructions(&chip8, &config, instructions ? instructions : 1000000);
+    const uint64_t elapsed = now_ns() - start;
+    if (server)
+        stop_debug_server(server);
+
+    printf("rom: %s\ninstructions: %llu\nframes: %llu\nseconds: %.6f\ndisplay hash: %016llx\n",
+           chip8.rom_name, (unsigned long long)executed,
+           (unsigned long long)(frames ? chip8.frame : executed / (config.instructions_per_second / 60)),
+           elapsed / 1e9, (unsigned long long)hash_display(&chip8));
+    print_fault(&chip8, stdout);
+#ifdef PROFILE
+    if (profile)
+    {
+        if (!write_profile_json(&chip8, profile))
+            return -1;
+    }
+    else
+        print_profile(&chip8, stdout);
+#endif
+    if (audio_path)
+    {
+        printf("audio: %llu samples (%.2f s), %llu frames dropped, %llu underruns\n",
+               (unsigned long long)sink.samples, (double)sink.samples / audio.rate,
+               (unsigned long long)audio.dropped, (unsigned long long)audio.underruns);
+        close_audio_sink(&sink);
+    }
+    if (trace_path && !dump_trace(&trace, trace_path))
+        return -1;
+    release_trace(&trace);
+    if (snapshot_file)
+        fclose(snapshot_file);
+    stop_input_log(&log, NULL);
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Input logs: everything outside the machine that decides a run, so it can be replayed
+// exactly. Keys are sampled once per frame, before the frame runs, so an event is the
+// keypad as a 16 bit mask and the frame it applies from. Layout, integers little endian:
+//   header "C8IN", u16 version, u8 extension, u8 quirk profile, u8 timing, u32 instructions per
+//          second, u64 RNG seed, u64 RAM hash at start
+//   events varint (frames since the previous event << 1 | 1 = end of log), then u16 keypad
+//          mask unless it is the end
+// A run where the keys change every few frames costs about 3 bytes per change.
+
+#define INPUT_MAGIC "C8IN"
+
+static void put_le(FILE *file, uint64_t value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+static bool get_le(FILE *file, uint64_t *value, size_t n)
+{
+    *value = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        *value |= (uint64_t)byte << (8 * i);
+    }
+    return true;
+}
+
+static void put_varint(FILE *file, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+static bool get_varint(FILE *file, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        const int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static uint16_t keypad_mask(const chip8_t *chip8)
+{
+    uint16_t keys = 0;
+    for (int i = 0; i < 16; i++)
+        keys |= chip8->keypad[i] << i;
+    return keys;
+}
+
+// FNV-1a over RAM, ties a log to the ROM it was recorded on
+static uint64_t hash_ram(const chip8_t *chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < EXT_RAM_SIZE(chip8->extension); i++)
+        hash = (hash ^ chip8->ram[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+// Start logging a machine that was just initialized and seeded with seed
+bool start_recording(input_log_t *log, const char *path, const chip8_t *chip8, const config_t *config, uint64_t seed)
+{
+    memset(log, 0, sizeof *log);
+    log->file = fopen(path, "wb");
+    if (!log->file)
+    {
+        printf("Could not create input log %s\n", path);
+        return false;
+    }
+    log->recording = true;
+    log->frame = chip8->frame;
+    log->keys = 0;
+    log->seed = seed;
+    log->instructions_per_second = config->instructions_per_second;
+
+    fwrite(INPUT_MAGIC, 4, 1, log->file);
+    put_le(log->file, INPUT_VERSION, 2);
+    put_le(log->file, chip8->extension, 1);
+    put_le(log->file, config->quirk_profile, 1);
+    put_le(log->file, config->timing, 1);
+    put_le(log->file, config->instructions_per_second, 4);
+    put_le(log->file, seed, 8);
+    put_le(log->file, hash_ram(chip8), 8);
+    return true;
+}
+
+// Call before every frame: logs the keypad if it changed since the last event
+void record_input(input_log_t *log, const chip8_t *chip8)
+{
+    const uint16_t keys = keypad_mask(chip8);
+    if (keys == log->keys)
+        return;
+    put_varint(log->file, (chip8->frame - log->frame) << 1);
+    put_le(log->file, keys, 2);
+    log->frame = chip8->frame;
+    log->keys = keys;
+}
+
+static void read_event(input_log_t *log)
+{
+    uint64_t delta, keys = 0;
+    if (!get_varint(log->file, &delta) || (!(delta & 1) && !get_le(log->file, &keys, 2)))
+    {
+        printf("Input log is truncated, replaying it as if it ended here\n");
+        delta = 1;
+    }
+    log->frame += delta >> 1;
+    log->ended = delta & 1;
+    log->next_keys = keys;
+}
+
+// Open a log for replay: the machine, just initialized from the same ROM, gets the recorded
+// seed and the config the recorded instruction rate, timing and quirks
+bool start_replay(input_log_t *log, const char *path, chip8_t *chip8, config_t *config)
+{
+    memset(log, 0, sizeof *log);
+    log->file = fopen(path, "rb");
+    if (!log->file)
+    {
+        printf("Could not open input log %s\n", path);
+        return false;
+    }
+
+    char magic[4];
+    uint64_t version, extension, profile, timing, ips, seed, hash;
+    if (fread(magic, 4, 1, log->file) != 1 || memcmp(magic, INPUT_MAGIC, 4) || !get_le(log->file, &version, 2))
+    {
+        printf("%s is not an input log\n", path);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (version != INPUT_VERSION)
+    {
+        printf("Input log version %u, this build reads version %u\n", (unsigned)version, INPUT_VERSION);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (!get_le(log->file, &extension, 1) || !get_le(log->file, &profile, 1) || !get_le(log->file, &timing, 1) ||
+        !get_le(log->file, &ips, 4) || !get_le(log->file, &seed, 8) || !get_le(log->file, &hash, 8))
+    {
+        printf("Input log %s is truncated\n", path);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (extension != chip8->extension)
+    {
+        printf("Input log %s was recorded on a %s machine, this one is %s (--extension)\n", path,
+               extension <= EXT_XOCHIP ? extension_names[extension] : "unknown", extension_names[chip8->extension]);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (profile > QUIRKS_XOCHIP)
+    {
+        printf("Input log %s was recorded with unknown quirks\n", path);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (timing > TIMING_VIP || (timing == TIMING_VIP && extension != EXT_CHIP8))
+    {
+        printf("Input log %s was recorded with unknown timing\n", path);
+        stop_input_log(log, NULL);
+        return false;
+    }
+    if (hash != hash_ram(chip8))
+        printf("Warning: input log %s was recorded on a different ROM\n", path);
+
+    log->seed = seed;
+    log->instructions_per_second = ips;
+    log->frame = chip8->frame;
+    seed_chip8(chip8, seed);
+    config->instructions_per_second = ips;
+    if (timing != config->timing)
+    {
+        printf("Replaying with %s timing, as recorded\n", timing == TIMING_VIP ? "VIP" : "flat");
+        config->timing = timing;
+        invalidate_code(chip8); // Predecoded instructions carry their cycles
+    }
+    if (profile != config->quirk_profile)
+    {
+        printf("Replaying with the recorded %s quirks\n", quirk_profile_names[profile]);
+        config->quirk_profile = profile;
+        config->quirks = quirk_profiles[profile];
+        invalidate_code(chip8); // Handlers are picked for the quirks
+    }
+    read_event(log);
+    return true;
+}
+
+// Call before every frame: applies the events due at this frame.
+// Returns false once the log has ended, the frame the recording stopped at
+bool replay_input(input_log_t *log, chip8_t *chip8)
+{
+    while (!log->ended && log->frame <= chip8->frame)
+    {
+        for (int i = 0; i < 16; i++)
+            chip8->keypad[i] = (log->next_keys >> i) & 1;
+        read_event(log);
+    }
+    return !(log->ended && log->frame <= chip8->frame);
+}
+
+// Ends a recording with the frame it stopped at, or closes a replay
+void stop_input_log(input_log_t *log, const chip8_t *chip8)
+{
+    if (!log->file)
+        return;
+    if (log->recording && chip8)
+        put_varint(log->file, (chip8->frame - log->frame) << 1 | 1);
+    fclose(log->file);
+    log->file = NULL;
+}
@@ -0,0 +1,407 @@
+#ifdef JIT
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "chip8.h"
+
+#if !defined(__x86_64__)
+#error "The JIT backend only targets x86-64, build without -DJIT"
+#endif
+
+// x86-64 native code generator for hot blocks.
+// Compiles a whole translated block (its block_entry_t list) into one function
+// `uint16_t code(chip8_t *chip8, const config_t *config)` that does what run_block_code does:
+// inline ops become a few instructions on the V registers in the machine, skips become
+// conditional branches over the next entry's code, a followed call pushes its return address,
+// and everything else (the terminator included) calls its predecoded handler. V stays in
+// memory, addressed from RBX, so handler calls need no spilling; x86 operates on it directly.
+// The buffer is never writable and executable at once: it is made writable for a compile and
+// executable again before the code runs.
+// Code is invalidated together with the blocks (flush_blocks) when RAM under them is written.
+
+#define JIT_BUFFER_SIZE (256 * 1024)
+#define JIT_MAX_CODE 4096 // Upper bound for the code of one block (BLOCK_MAX entries of at most 40 bytes)
+
+// Host registers, x86-64 encoding numbers
+enum
+{
+    RAX = 0, RDX = 2, RBX = 3,
+};
+
+// Condition codes for Jcc
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+
+typedef struct
+{
+    uint8_t *code;
+    size_t len;
+} emitter_t;
+
+static void emit8(emitter_t *e, uint8_t b)
+{
+    e->code[e->len++] = b;
+}
+
+static void emit16(emitter_t *e, uint16_t v)
+{
+    emit8(e, v & 0xFF);
+    emit8(e, v >> 8);
+}
+
+static void emit32(emitter_t *e, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        emit8(e, v >> (8 * i));
+}
+
+static void emit_bytes(emitter_t *e, const uint8_t *bytes, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        emit8(e, bytes[i]);
+}
+
+// [rbx + disp32] memory operand, reg = register or opcode extension
+static void emit_mem(emitter_t *e, uint8_t reg, uint32_t disp)
+{
+    emit8(e, 0x80 | (reg & 7) << 3 | RBX);
+    emit32(e, disp);
+}
+
+// [rbx + rax * scale + disp32] memory operand, scale as a shift count
+static void emit_mem_indexed(emitter_t *e, uint8_t reg, uint8_t scale, uint32_t disp)
+{
+    emit8(e, 0x84 | (reg & 7) << 3);
+    emit8(e, scale << 6 | RAX << 3 | RBX);
+    emit32(e, disp);
+}
+
+// op byte [rbx + disp], imm8 (0x80 group, or 0xC6 /0 for mov)
+static void emit_mi8(emitter_t *e, uint8_t opcode, uint8_t digit, uint32_t disp, uint8_t imm)
+{
+    emit8(e, opcode);
+    emit_mem(e, digit, disp);
+    emit8(e, imm);
+}
+
+// movzx reg32, byte [rbx + disp]
+static void emit_load8(emitter_t *e, uint8_t reg, uint32_t disp)
+{
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emit_mem(e, reg, disp);
+}
+
+// op byte [rbx + disp], al or op al, byte [rbx + disp] (8 bit ALU forms, by opcode)
+static void emit_al_mem(emitter_t *e, uint8_t opcode, uint32_t disp)
+{
+    emit8(e, opcode);
+    emit_mem(e, RAX, disp);
+}
+
+#define OP_ADD_MR 0x00
+#define OP_OR_MR 0x08
+#define OP_AND_MR 0x20
+#define OP_SUB_MR 0x28
+#define OP_XOR_MR 0x30
+#define OP_MOV_MR 0x88
+#define OP_SUB_RM 0x2A
+#define OP_CMP_RM 0x3A
+#define IMM_ADD 0
+#define IMM_CMP 7
+
+// Short conditional jump, target patched once known
+static size_t emit_jcc8(emitter_t *e, uint8_t cc)
+{
+    emit8(e, 0x70 | cc);
+    emit8(e, 0);
+    return e->len - 1;
+}
+
+static void patch8(emitter_t *e, size_t at)
+{
+    e->code[at] = (uint8_t)(e->len - (at + 1));
+}
+
+static size_t emit_jmp32(emitter_t *e)
+{
+    emit8(e, 0xE9);
+    emit32(e, 0);
+    return e->len - 4;
+}
+
+static void patch32(emitter_t *e, size_t at)
+{
+    const uint32_t rel = (uint32_t)(e->len - (at + 4));
+    memcpy(&e->code[at], &rel, 4);
+}
+
+// Flag of a subtraction in EAX (VX - VY as 32 bits): 1 when nothing was borrowed
+static void emit_no_borrow(emitter_t *e)
+{
+    static const uint8_t code[] = {
+        0xC1, 0xE8, 0x1F, // shr eax, 31
+        0x83, 0xF0, 0x01, // xor eax, 1
+    };
+    emit_bytes(e, code, sizeof code);
+}
+
+// VX = a - b with the no-borrow flag in VF, VF written last so it holds the flag when X = F
+static void emit_sub(emitter_t *e, uint8_t X, uint8_t a, uint8_t b)
+{
+    const uint32_t V = offsetof(chip8_t, V);
+    static const uint8_t sub_eax_edx[] = {0x29, 0xD0};
+    emit_load8(e, RAX, V + a);
+    emit_load8(e, RDX, V + b);
+    emit_bytes(e, sub_eax_edx, sizeof sub_eax_edx);
+    emit_al_mem(e, OP_MOV_MR, V + X);
+    emit_no_borrow(e);
+    emit_al_mem(e, OP_MOV_MR, V + 0xF);
+}
+
+// handler(chip8, &chip8->icache[pc], config), the handler read from the predecoded instruction
+static void emit_call_handler(emitter_t *e, uint16_t pc)
+{
+    static const uint8_t set_args[] = {
+        0x48, 0x89, 0xDF, // mov rdi, rbx
+        0x48, 0x89, 0xEA, // mov rdx, rbp
+    };
+    static const uint8_t call_handler[] = {0xFF, 0x16}; // call [rsi]
+    emit_bytes(e, set_args, sizeof set_args);
+    emit8(e, 0x48); // lea rsi, [rbx + icache + pc]
+    emit8(e, 0x8D);
+    emit_mem(e, 6, offsetof(chip8_t, icache) + pc * sizeof(instruction_t));
+    emit_bytes(e, call_handler, sizeof call_handler);
+}
+
+// Rest of a skip, after its compare: the next entry runs on run_cc, a taken skip counts itself
+// and jumps past that entry. Returns where the jump is, to be patched once the entry is emitted
+static size_t emit_skip(emitter_t *e, uint8_t run_cc)
+{
+    static const uint8_t inc_r12d[] = {0x41, 0xFF, 0xC4};
+    const size_t run = emit_jcc8(e, run_cc);
+    emit_bytes(e, inc_r12d, sizeof inc_r12d);
+    const size_t past = emit_jmp32(e);
+    patch8(e, run);
+    return past;
+}
+
+// Emit one entry. Skips return where their taken path jumps from (see emit_skip); everything
+// else returns 0
+static size_t emit_entry(emitter_t *e, const block_entry_t *entry)
+{
+    const uint32_t V = offsetof(chip8_t, V);
+    const uint32_t I = offsetof(chip8_t, I);
+    const uint8_t X = entry->X;
+    const uint8_t Y = entry->Y;
+    static const uint8_t add_eax_edx[] = {0x01, 0xD0};
+    static const uint8_t shr_eax_8[] = {0xC1, 0xE8, 0x08};
+    static const uint8_t and_eax_f[] = {0x83, 0xE0, 0x0F};
+    size_t jcc;
+
+    switch ((block_op_t)entry->op)
+    {
+    case BOP_6XNN:
+        emit_mi8(e, 0xC6, 0, V + X, entry->NN);
+        break;
+    case BOP_7XNN:
+        emit_mi8(e, 0x80, IMM_ADD, V + X, entry->NN);
+        break;
+    case BOP_8XY0:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_MOV_MR, V + X);
+        break;
+    case BOP_8XY1:
+    case BOP_8XY1_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_OR_MR, V + X);
+        if (entry->op == BOP_8XY1)
+            emit_mi8(e, 0xC6, 0, V + 0xF, 0);
+        break;
+    case BOP_8XY2:
+    case BOP_8XY2_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_AND_MR, V + X);
+        if (entry->op == BOP_8XY2)
+            emit_mi8(e, 0xC6, 0, V + 0xF, 0);
+        break;
+    case BOP_8XY3:
+    case BOP_8XY3_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_XOR_MR, V + X);
+        if (entry->op == BOP_8XY3)
+            emit_mi8(e, 0xC6, 0, V + 0xF, 0);
+        break;
+    case BOP_8XY4:
+        emit_load8(e, RAX, V + X);
+        emit_load8(e, RDX, V + Y);
+        emit_bytes(e, add_eax_edx, sizeof add_eax_edx);
+        emit_al_mem(e, OP_MOV_MR, V + X);
+        emit_bytes(e, shr_eax_8, sizeof shr_eax_8); // Sum is at most 510, carry is bit 8
+        emit_al_mem(e, OP_MOV_MR, V + 0xF);
+        break;
+    case BOP_8XY4_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_ADD_MR, V + X);
+        break;
+    case BOP_8XY5:
+        emit_sub(e, X, X, Y);
+        break;
+    case BOP_8XY5_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_SUB_MR, V + X);
+        break;
+    case BOP_8XY7:
+        emit_sub(e, X, Y, X);
+        break;
+    case BOP_8XY7_NF:
+        emit_load8(e, RAX, V + Y);
+        emit_al_mem(e, OP_SUB_RM, V + X);
+        emit_al_mem(e, OP_MOV_MR, V + X);
+        break;
+    case BOP_ANNN:
+        emit8(e, 0x66); // mov word [I], NNN
+        emit8(e, 0xC7);
+        emit_mem(e, 0, I);
+        emit16(e, entry->NNN);
+        break;
+    case BOP_FX1E:
+        emit_load8(e, RAX, V + X);
+        emit8(e, 0x66); // add word [I], ax
+        emit_al_mem(e, 0x01, I);
+        break;
+
+    case BOP_SKIP_EQ:
+    case BOP_SKIP_NE:
+        emit_mi8(e, 0x80, IMM_CMP, V + X, entry->NN);
+        return emit_skip(e, entry->op == BOP_SKIP_EQ ? CC_NE : CC_E);
+    case BOP_SKIP_EQ_V:
+    case BOP_SKIP_NE_V:
+        emit_load8(e, RAX, V + X);
+        emit_al_mem(e, OP_CMP_RM, V + Y);
+        return emit_skip(e, entry->op == BOP_SKIP_EQ_V ? CC_NE : CC_E);
+    case BOP_SKIP_KEY:
+    case BOP_SKIP_NO_KEY:
+        emit_load8(e, RAX, V + X);
+        emit_bytes(e, and_eax_f, sizeof and_eax_f); // Low nibble picks the key
+        emit8(e, 0x80);                             // cmp byte [keypad + rax], 0
+        emit_mem_indexed(e, IMM_CMP, 0, offsetof(chip8_t, keypad));
+        emit8(e, 0);
+        return emit_skip(e, entry->op == BOP_SKIP_KEY ? CC_E : CC_NE);
+
+    case BOP_CALL:
+        // As 2NNN: past the stack depth the return adress is lost
+        emit_load8(e, RAX, offsetof(chip8_t, stack_depth));
+        emit8(e, 0x83); // cmp eax, STACK_DEPTH
+        emit8(e, 0xF8);
+        emit8(e, STACK_DEPTH);
+        jcc = emit_jcc8(e, CC_AE);
+        emit8(e, 0x66); // mov word [stack + rax * 2], return address
+        emit8(e, 0xC7);
+        emit_mem_indexed(e, 0, 1, offsetof(chip8_t, stack));
+        emit16(e, entry->pc + 2);
+        emit8(e, 0xFE); // inc byte [stack_depth]
+        emit_mem(e, 0, offsetof(chip8_t, stack_depth));
+        patch8(e, jcc);
+        break;
+    case BOP_JUMP:
+        break;
+    case BOP_TERMINATOR:
+        // The terminator sees PC pointing past it, as in the single step engines
+        emit8(e, 0x66); // mov word [PC], pc + 2
+        emit8(e, 0xC7);
+        emit_mem(e, 0, offsetof(chip8_t, PC));
+        emit16(e, entry->pc + 2);
+        emit_call_handler(e, entry->pc);
+        break;
+    case BOP_HANDLER:
+    default:
+        emit_call_handler(e, entry->pc);
+        break;
+    }
+    return 0;
+}
+
+static bool map_buffer(jit_t *jit)
+{
+    void *buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED)
+        return false;
+    jit->buffer = buffer;
+    jit->used = 0;
+    return true;
+}
+
+// Compile the translated block at pc. Returns false when it could not be compiled; the block
+// then keeps running as threaded code
+bool jit_compile(chip8_t *chip8, uint16_t pc)
+{
+    jit_t *jit = &chip8->jit;
+    if (!jit->buffer && !map_buffer(jit))
+        return false;
+    if (jit->used + JIT_MAX_CODE > JIT_BUFFER_SIZE)
+        jit_flush(chip8); // Out of code space: start over, hot blocks get recompiled
+    if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE))
+        return false;
+
+    static const uint8_t prologue[] = {
+        0x53,             // push rbx (three pushes realign the stack for calls)
+        0x55,             // push rbp
+        0x41, 0x54,       // push r12
+        0x48, 0x89, 0xFB, // mov rbx, rdi: chip8
+        0x48, 0x89, 0xF5, // mov rbp, rsi: config
+        0x45, 0x31, 0xE4, // xor r12d, r12d: entries skipped
+    };
+    static const uint8_t epilogue[] = {
+        0x44, 0x89, 0xE0, // mov eax, r12d
+        0x41, 0x5C,       // pop r12
+        0x5D,             // pop rbp
+        0x5B,             // pop rbx
+        0xC3,             // ret
+    };
+
+    const block_entry_t *code = &chip8->block_code[chip8->block_start[pc]];
+    const uint16_t entries = chip8->block_entries[pc];
+    emitter_t e = {.code = jit->buffer + jit->used};
+    emit_bytes(&e, prologue, sizeof prologue);
+    size_t past_skipped = 0;
+    for (uint16_t i = 0; i < entries; i++)
+    {
+        const size_t past = emit_entry(&e, &code[i]);
+        if (past_skipped)
+            patch32(&e, past_skipped); // The skip before this entry jumps here when taken
+        past_skipped = past;
+    }
+    emit_bytes(&e, epilogue, sizeof epilogue);
+
+    if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC))
+        return false;
+    jit->code[pc] = (jit_code_t)(void *)e.code;
+    jit->used += e.len;
+    return true;
+}
+
+// Forget all compiled code, called whenever translated blocks are flushed
+void jit_flush(chip8_t *chip8)
+{
+    jit_t *jit = &chip8->jit;
+    memset(jit->code, 0, sizeof jit->code);
+    memset(jit->hits, 0, sizeof jit->hits);
+    jit->used = 0;
+}
+
+void jit_release(chip8_t *chip8)
+{
+    if (chip8->jit.buffer)
+        munmap(chip8->jit.buffer, JIT_BUFFER_SIZE);
+    chip8->jit.buffer = NULL;
+    jit_flush(chip8);
+}
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Profile reports. Built only with -DPROFILE (make profile, make headless-profile), which
+// also compiles the counters into the engines; without it the engines carry no trace of them.
+// Cycles are host clock ticks, the time stamp counter on x86 and nanoseconds elsewhere. The
+// single step engines time every instruction; the block engines time whole blocks and share
+// the ticks equally between the instructions of the block, so their per address cycles are
+// an approximation while the counts stay exact.
+
+#define PROFILE_HOT_PCS 20 // Addresses listed in the text report
+
+static const char *family_names[16] = {
+    "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XYN", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EXNN", "FXNN",
+};
+
+static profile_counter_t profile_total(const profile_t *profile)
+{
+    profile_counter_t total = {0};
+    for (int i = 0; i < 16; i++)
+    {
+        total.count += profile->family[i].count;
+        total.cycles += profile->family[i].cycles;
+    }
+    return total;
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static const profile_t *sort_profile; // qsort has no context argument
+
+// Hottest first by cycles, then by count, then by address
+static int compare_pcs(const void *a, const void *b)
+{
+    const profile_counter_t *x = &sort_profile->pc[*(const uint16_t *)a];
+    const profile_counter_t *y = &sort_profile->pc[*(const uint16_t *)b];
+    if (x->cycles != y->cycles)
+        return x->cycles < y->cycles ? 1 : -1;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+void print_profile(const chip8_t *chip8, FILE *out)
+{
+    const profile_t *profile = &chip8->profile;
+    const profile_counter_t total = profile_total(profile);
+
+    fprintf(out, "profile: %s\n", chip8->rom_name);
+    fprintf(out, "instructions: %llu, cycles: %llu (%.1f per instruction)\n",
+            (unsigned long long)total.count, (unsigned long long)total.cycles,
+            total.count ? (double)total.cycles / total.count : 0.0);
+
+    fprintf(out, "\n%-6s %14s %7s %16s %7s %8s\n", "family", "count", "%", "cycles", "%", "cyc/ins");
+    for (int i = 0; i < 16; i++)
+    {
+        const profile_counter_t *f = &profile->family[i];
+        if (!f->count)
+            continue;
+        fprintf(out, "%-6s %14llu %6.2f%% %16llu %6.2f%% %8.1f\n", family_names[i],
+                (unsigned long long)f->count, percent(f->count, total.count),
+                (unsigned long long)f->cycles, percent(f->cycles, total.cycles),
+                (double)f->cycles / f->count);
+    }
+
+    static uint16_t pcs[0x1000];
+    size_t n = 0;
+    for (uint16_t pc = 0; pc < 0x1000; pc++)
+    {
+        if (profile->pc[pc].count)
+            pcs[n++] = pc;
+    }
+    sort_profile = profile;
+    qsort(pcs, n, sizeof pcs[0], compare_pcs);
+
+    fprintf(out, "\nhot addresses (%zu executed)\n%-6s %-6s %14s %16s %7s\n", n, "pc", "opcode", "count", "cycles", "%");
+    for (size_t i = 0; i < n && i < PROFILE_HOT_PCS; i++)
+    {
+        const profile_counter_t *c = &profile->pc[pcs[i]];
+        fprintf(out, "0x%03X  %04X   %14llu %16llu %6.2f%%\n", pcs[i], profile->opcode[pcs[i]],
+                (unsigned long long)c->count, (unsigned long long)c->cycles, percent(c->cycles, total.cycles));
+    }
+
+    fprintf(out, "\ndraws: %llu, pixels: %llu (%.1f per draw)\n", (unsigned long long)profile->draws,
+            (unsigned long long)profile->pixels, profile->draws ? (double)profile->pixels / profile->draws : 0.0);
+    fprintf(out, "frames: %llu, drawing: %llu (%.1f%%)\n", (unsigned long long)profile->frames,
+            (unsigned long long)profile->draw_frames, percent(profile->draw_frames, profile->frames));
+}
+
+static void put_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; s && *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// The whole profile as JSON, every executed address included, for scripts comparing ROMs
+bool write_profile_json(const chip8_t *chip8, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        printf("Could not create profile %s\n", path);
+        return false;
+    }
+
+    const profile_t *profile = &chip8->profile;
+    const profile_counter_t total = profile_total(profile);
+    fprintf(out, "{\n  \"rom\": ");
+    put_json_string(out, chip8->rom_name);
+    fprintf(out, ",\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n",
+            (unsigned long long)total.count, (unsigned long long)total.cycles);
+
+    fprintf(out, "  \"families\": [");
+    const char *sep = "";
+    for (int i = 0; i < 16; i++)
+    {
+        const profile_counter_t *f = &profile->family[i];
+        if (!f->count)
+            continue;
+        fprintf(out, "%s\n    {\"family\": \"%s\", \"count\": %llu, \"cycles\": %llu}", sep, family_names[i],
+                (unsigned long long)f->count, (unsigned long long)f->cycles);
+        sep = ",";
+    }
+
+    fprintf(out, "\n  ],\n  \"pcs\": [");
+    sep = "";
+    for (uint16_t pc = 0; pc < 0x1000; pc++)
+    {
+        const profile_counter_t *c = &profile->pc[pc];
+        if (!c->count)
+            continue;
+        fprintf(out, "%s\n    {\"pc\": %u, \"opcode\": %u, \"count\": %llu, \"cycles\": %llu}", sep, pc,
+                profile->opcode[pc], (unsigned long long)c->count, (unsigned long long)c->cycles);
+        sep = ",";
+    }
+
+    fprintf(out, "\n  ],\n  \"draws\": %llu,\n  \"pixels\": %llu,\n  \"frames\": %llu,\n  \"draw_frames\": %llu\n}\n",
+            (unsigned long long)profile->draws, (unsigned long long)profile->pixels,
+            (unsigned long long)profile->frames, (unsigned long long)profile->draw_frames);
+
+    const bool ok = !ferror(out);
+    if (fclose(out) || !ok)
+    {
+        printf("Could not write profile %s\n", path);
+        return false;
+    }
+    return true;
+}
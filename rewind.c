@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Rewind history: one save state per frame in a byte ring carved, with its index, out of a
+// single allocation made up front. Every REWIND_KEYFRAME frames the state is complete, in
+// between it is a delta against the previous frame, so a minute of a typical ROM fits in a
+// few hundred KB. Stepping back reloads the nearest complete state and applies the deltas
+// after it, at most REWIND_KEYFRAME - 1 of them, into a snapshot; only the final state is
+// put in the machine. When the ring is full the oldest frames are dropped, always back to
+// a complete state so the history never starts with a delta.
+
+typedef struct rewind_entry
+{
+    uint32_t offset; // Where the state starts in the ring
+    uint32_t size;
+    bool keyframe;   // Complete state, the start of a chain
+} rewind_entry_t;
+
+// Room for at least the given number of frames: dropping the oldest frames goes back to a
+// keyframe, so the index has a keyframe interval more entries than that
+bool init_rewind(rewind_t *rw, uint32_t frames, size_t ring_size)
+{
+    memset(rw, 0, sizeof *rw);
+    if (ring_size < 2 * SAVESTATE_MAX_SIZE || frames < REWIND_KEYFRAME)
+    {
+        printf("Rewind needs at least %u frames and %zu bytes\n", REWIND_KEYFRAME, 2 * SAVESTATE_MAX_SIZE);
+        return false;
+    }
+
+    frames += REWIND_KEYFRAME;
+    rw->arena = malloc(frames * sizeof(rewind_entry_t) + ring_size);
+    if (!rw->arena)
+    {
+        printf("Could not allocate %zu bytes of rewind history\n", frames * sizeof(rewind_entry_t) + ring_size);
+        return false;
+    }
+    rw->entries = (rewind_entry_t *)rw->arena;
+    rw->max_entries = frames;
+    rw->ring = rw->arena + frames * sizeof(rewind_entry_t);
+    rw->ring_size = ring_size;
+    return true;
+}
+
+void release_rewind(rewind_t *rw)
+{
+    free(rw->arena);
+    memset(rw, 0, sizeof *rw);
+}
+
+// Bytes the history holds right now
+size_t rewind_used(const rewind_t *rw)
+{
+    if (!rw->count)
+        return 0;
+    const uint32_t oldest = rw->entries[rw->first].offset;
+    return rw->write > oldest ? rw->write - oldest : rw->ring_size - oldest + rw->write;
+}
+
+static rewind_entry_t *entry(const rewind_t *rw, uint32_t i)
+{
+    return &rw->entries[(rw->first + i) % rw->max_entries];
+}
+
+static void drop_oldest(rewind_t *rw)
+{
+    do
+    {
+        rw->first = (rw->first + 1) % rw->max_entries;
+        rw->count--;
+    } while (rw->count && !entry(rw, 0)->keyframe);
+}
+
+// Contiguous free bytes at the write position, wrapping it to the start of the ring
+// when the end is too short for a state
+static size_t free_bytes(rewind_t *rw)
+{
+    if (!rw->count)
+    {
+        rw->write = 0;
+        return rw->ring_size;
+    }
+    const uint32_t oldest = entry(rw, 0)->offset;
+    if (rw->write <= oldest)
+        return oldest - rw->write;
+    if (rw->ring_size - rw->write >= SAVESTATE_MAX_SIZE)
+        return rw->ring_size - rw->write;
+    rw->write = 0;
+    return oldest;
+}
+
+// Append the machine's state after a frame
+void rewind_record(rewind_t *rw, const chip8_t *chip8)
+{
+    if (rw->count == rw->max_entries)
+        drop_oldest(rw);
+    while (free_bytes(rw) < SAVESTATE_MAX_SIZE)
+        drop_oldest(rw);
+
+    const bool keyframe = !rw->count || ++rw->since_keyframe == REWIND_KEYFRAME;
+    if (keyframe)
+    {
+        rw->snap.valid = false; // Makes save_state write a complete state
+        rw->since_keyframe = 0;
+    }
+    rewind_entry_t *e = entry(rw, rw->count);
+    e->offset = rw->write;
+    e->size = save_state(chip8, &rw->snap, &rw->ring[rw->write], SAVESTATE_MAX_SIZE);
+    e->keyframe = keyframe;
+    rw->write += e->size;
+    rw->count++;
+}
+
+// Step the machine back one frame. False when there is no older frame left
+bool rewind_step(rewind_t *rw, chip8_t *chip8)
+{
+    if (rw->count < 2)
+        return false;
+    rw->count--; // The newest entry is the current state
+    rw->write = entry(rw, rw->count)->offset;
+
+    uint32_t key = rw->count - 1;
+    while (!entry(rw, key)->keyframe)
+        key--;
+    rw->since_keyframe = rw->count - 1 - key;
+
+    rw->snap.valid = false;
+    for (uint32_t i = key; i < rw->count; i++)
+    {
+        const rewind_entry_t *e = entry(rw, i);
+        if (!apply_state(&rw->snap, &rw->ring[e->offset], e->size, chip8->extension))
+            return false;
+    }
+    restore_snapshot(chip8, &rw->snap);
+    return true;
+}
@@ -0,0 +1,122 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+
+// ROM store for the headless runner (POSIX). Each file is mapped once and hashed; files with
+// the same content share one entry. An entry is the ROM's complete initial RAM (font and
+// program, see build_ram_image) in its own page, made read-only once built, so any number of
+// machines on any thread initialize from it with one copy and it cannot be scribbled on.
+// The image depends on the machine it is built for, so entries are per content and extension.
+
+// FNV-1a over the file contents
+static uint64_t hash_rom(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    return hash;
+}
+
+static const rom_image_t *find_rom(const rom_store_t *store, uint64_t hash, const uint8_t *data, size_t size,
+                                   extension_t extension)
+{
+    for (size_t i = 0; i < store->count; i++)
+    {
+        const rom_image_t *rom = store->roms[i];
+        if (rom->hash == hash && rom->size == size && rom->extension == extension &&
+            (!size || !memcmp(rom->program, data, size)))
+            return rom;
+    }
+    return NULL;
+}
+
+// New entry for content not in the store yet. Entries never move once added, callers
+// keep pointers to them
+static const rom_image_t *add_rom(rom_store_t *store, uint64_t hash, const uint8_t *data, size_t size,
+                                  extension_t extension, const char *path)
+{
+    if (store->count == store->cap)
+    {
+        const size_t cap = store->cap ? store->cap * 2 : 64;
+        rom_image_t **roms = realloc(store->roms, cap * sizeof *roms);
+        if (!roms)
+            return NULL;
+        store->roms = roms;
+        store->cap = cap;
+    }
+
+    rom_image_t *rom = malloc(sizeof *rom);
+    const size_t ram_size = EXT_RAM_SIZE(extension);
+    uint8_t *ram = mmap(NULL, ram_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!rom || ram == MAP_FAILED || !build_ram_image(ram, extension, data, size, path))
+    {
+        free(rom);
+        if (ram != MAP_FAILED)
+            munmap(ram, ram_size);
+        return NULL;
+    }
+    mprotect(ram, ram_size, PROT_READ);
+
+    rom->hash = hash;
+    rom->size = size;
+    rom->extension = extension;
+    rom->ram = ram;
+    rom->program = &ram[ENTRY_POINT];
+    store->roms[store->count++] = rom;
+    return rom;
+}
+
+// Add a ROM file for the given machine, or find the entry already holding the same content
+const rom_image_t *rom_store_add(rom_store_t *store, const char *path, extension_t extension)
+{
+    const int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        printf("Could not open ROM FILE: %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    const size_t size = st.st_size;
+    const uint8_t *data = NULL;
+    if (size)
+    {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            printf("Could not map ROM FILE: %s\n", path);
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd); // The mapping stays valid
+
+    const uint64_t hash = hash_rom(data, size);
+    const rom_image_t *rom = find_rom(store, hash, data, size, extension);
+    if (!rom && !(rom = add_rom(store, hash, data, size, extension, path)))
+        printf("Could not add %s to the ROM store\n", path);
+
+    if (size)
+        munmap((void *)data, size);
+    return rom;
+}
+
+void rom_store_release(rom_store_t *store)
+{
+    for (size_t i = 0; i < store->count; i++)
+    {
+        munmap((void *)store->roms[i]->ram, EXT_RAM_SIZE(store->roms[i]->extension));
+        free(store->roms[i]);
+    }
+    free(store->roms);
+    memset(store, 0, sizeof *store);
+}
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Save states. Layout, all integers little endian:
+//   header    "C8ST", u16 version, u8 sections present (SECTION_*), u8 1 = complete state, 0 = delta
+//   registers SAVESTATE_REGS_SIZE bytes, see pack_registers
+//   display   row mask, one bit per row, then the u64 words of each row in the mask
+//   ram       page mask, one bit per page, then RAM_PAGE bytes per page in the mask
+// Masks are little endian bit strings. How many rows, words and pages there are depends on
+// the machine (the extension register): CHIP8 has 32 rows of one word and 4 KB of RAM, SCHIP
+// 64 rows of two words, XO-CHIP two planes of those and 64 KB; a row holds every plane's
+// words, plane by plane, left to right.
+// A full state always has the registers, and leaves out the display rows and RAM pages that
+// are all zero (a section with none left is left out too): an XO-CHIP keyframe costs about
+// the size of the ROM rather than 64 KB. A delta against a snapshot only carries the
+// registers if any changed, and only the display rows and RAM pages that changed, so a
+// frame that moved a sprite costs a few hundred bytes instead of 4 KB.
+// Host pointers (rom_name) and derived engine state (caches, blocks, JIT) are not saved.
+
+#define SAVESTATE_MAGIC "C8ST"
+#define SECTION_REGISTERS 0x01
+#define SECTION_DISPLAY 0x02
+#define SECTION_RAM 0x04
+#define REG_EXTENSION 67 // Where pack_registers puts the extension
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+} writer_t;
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} reader_t;
+
+static void put(writer_t *w, const void *src, size_t n)
+{
+    if (w->size + n <= w->cap)
+        memcpy(w->data + w->size, src, n);
+    w->size += n; // Keeps counting past cap so the caller can tell how much was needed
+}
+
+static void put_le(writer_t *w, uint64_t value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint8_t byte = value >> (8 * i);
+        put(w, &byte, 1);
+    }
+}
+
+static bool get(reader_t *r, void *dst, size_t n)
+{
+    if (r->size - r->pos < n)
+        return false;
+    memcpy(dst, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+static bool get_le(reader_t *r, uint64_t *value, size_t n)
+{
+    uint8_t bytes[8];
+    if (!get(r, bytes, n))
+        return false;
+    *value = 0;
+    for (size_t i = 0; i < n; i++)
+        *value |= (uint64_t)bytes[i] << (8 * i);
+    return true;
+}
+
+static void store_le(uint8_t *dst, uint64_t value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = value >> (8 * i);
+}
+
+static uint64_t load_le(const uint8_t *src, size_t n)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++)
+        value |= (uint64_t)src[i] << (8 * i);
+    return value;
+}
+
+// Every register of the machine in a fixed byte layout, so snapshots compare them with one memcmp
+static void pack_registers(const chip8_t *chip8, uint8_t *regs)
+{
+    uint16_t keys = 0;
+    for (int i = 0; i < 16; i++)
+        keys |= chip8->keypad[i] << i;
+
+    regs[0] = chip8->state;
+    memcpy(&regs[1], chip8->V, 16);
+    store_le(&regs[17], chip8->I, 2);
+    store_le(&regs[19], chip8->PC, 2);
+    regs[21] = chip8->stack_depth;
+    for (int i = 0; i < STACK_DEPTH; i++)
+        store_le(&regs[22 + 2 * i], chip8->stack[i], 2);
+    regs[46] = chip8->delay_timer;
+    regs[47] = chip8->sound_timer;
+    store_le(&regs[48], keys, 2);
+    regs[50] = chip8->wait_key;
+    store_le(&regs[51], chip8->frame, 8);
+    store_le(&regs[59], chip8->rng, 8);
+    regs[REG_EXTENSION] = chip8->extension;
+    regs[68] = chip8->hires;
+    regs[69] = chip8->planes;
+    memcpy(&regs[70], chip8->rpl, 16);
+    regs[86] = chip8->pitch;
+    memcpy(&regs[87], chip8->pattern, AUDIO_PATTERN);
+    store_le(&regs[103], (uint32_t)chip8->cycles, 4);
+    store_le(&regs[107], chip8->frame_done, 4);
+}
+
+static bool registers_valid(const uint8_t *regs)
+{
+    return regs[0] <= PAUSED && regs[21] <= STACK_DEPTH && (regs[50] <= 0xF || regs[50] == 0xFF) &&
+           regs[REG_EXTENSION] <= EXT_XOCHIP && regs[68] <= 1 && regs[69] <= 3;
+}
+
+// Display and RAM geometry of a machine, from its extension
+typedef struct
+{
+    uint32_t rows;
+    uint32_t words;  // Per plane and row
+    uint32_t planes;
+    uint32_t pages;  // Of RAM
+} layout_t;
+
+static layout_t state_layout(extension_t extension)
+{
+    return (layout_t){
+        .rows = extension == EXT_CHIP8 ? DISPLAY_HEIGHT : HIRES_HEIGHT,
+        .words = extension == EXT_CHIP8 ? 1 : DISPLAY_WORDS,
+        .planes = extension == EXT_XOCHIP ? DISPLAY_PLANES : 1,
+        .pages = EXT_RAM_SIZE(extension) / RAM_PAGE,
+    };
+}
+
+static bool row_changed(const uint64_t (*a)[DISPLAY_WORDS][HIRES_HEIGHT], const uint64_t (*b)[DISPLAY_WORDS][HIRES_HEIGHT],
+                        const layout_t *l, uint32_t y)
+{
+    for (uint32_t p = 0; p < l->planes; p++)
+    {
+        for (uint32_t w = 0; w < l->words; w++)
+        {
+            if (a[p][w][y] != b[p][w][y])
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool zero(const uint8_t *bytes, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (bytes[i])
+            return false;
+    }
+    return true;
+}
+
+static void put_mask(writer_t *w, const uint8_t *mask, uint32_t bits)
+{
+    put(w, mask, bits / 8);
+}
+
+static bool get_mask(reader_t *r, uint8_t *mask, uint32_t bits)
+{
+    return get(r, mask, bits / 8);
+}
+
+static void unpack_registers(chip8_t *chip8, const uint8_t *regs)
+{
+    const uint16_t keys = load_le(&regs[48], 2);
+    chip8->state = regs[0];
+    memcpy(chip8->V, &regs[1], 16);
+    chip8->I = load_le(&regs[17], 2);
+    chip8->PC = load_le(&regs[19], 2);
+    chip8->stack_depth = regs[21];
+    for (int i = 0; i < STACK_DEPTH; i++)
+        chip8->stack[i] = load_le(&regs[22 + 2 * i], 2);
+    chip8->delay_timer = regs[46];
+    chip8->sound_timer = regs[47];
+    for (int i = 0; i < 16; i++)
+        chip8->keypad[i] = (keys >> i) & 1;
+    chip8->wait_key = regs[50];
+    chip8->frame = load_le(&regs[51], 8);
+    chip8->rng = load_le(&regs[59], 8);
+    chip8->hires = regs[68];
+    chip8->planes = regs[69];
+    memcpy(chip8->rpl, &regs[70], 16);
+    chip8->pitch = regs[86];
+    memcpy(chip8->pattern, &regs[87], AUDIO_PATTERN);
+    chip8->cycles = (int32_t)load_le(&regs[103], 4);
+    chip8->frame_done = load_le(&regs[107], 4);
+}
+
+// Serialize the machine. With a snapshot, only what changed since the snapshot is written
+// and the snapshot moves to the current state; without one (or before its first use) the
+// state is complete. Returns the size of the state, which may exceed cap (nothing is
+// written past cap, and the snapshot is left alone, in that case)
+size_t save_state(const chip8_t *chip8, snapshot_t *snap, uint8_t *buf, size_t cap)
+{
+    const bool full = !snap || !snap->valid;
+    uint8_t regs[SAVESTATE_REGS_SIZE];
+    pack_registers(chip8, regs);
+
+    const layout_t l = state_layout(chip8->extension);
+    static const uint64_t blank[DISPLAY_PLANES][DISPLAY_WORDS][HIRES_HEIGHT];
+    uint8_t rows[HIRES_HEIGHT / 8] = {0};
+    bool any_row = false;
+    for (uint32_t y = 0; y < l.rows; y++)
+    {
+        if (full ? row_changed(chip8->display, blank, &l, y) : row_changed(chip8->display, snap->display, &l, y))
+        {
+            rows[y / 8] |= 1 << (y % 8);
+            any_row = true;
+        }
+    }
+    uint8_t pages[XO_RAM_SIZE / RAM_PAGE / 8] = {0};
+    bool any_page = false;
+    for (uint32_t p = 0; p < l.pages; p++)
+    {
+        if (full ? !zero(&chip8->ram[p * RAM_PAGE], RAM_PAGE)
+                 : memcmp(&chip8->ram[p * RAM_PAGE], &snap->ram[p * RAM_PAGE], RAM_PAGE) != 0)
+        {
+            pages[p / 8] |= 1 << (p % 8);
+            any_page = true;
+        }
+    }
+    uint8_t sections = (any_row ? SECTION_DISPLAY : 0) | (any_page ? SECTION_RAM : 0);
+    if (full || memcmp(regs, snap->regs, sizeof regs))
+        sections |= SECTION_REGISTERS;
+
+    writer_t w = {.data = buf, .cap = cap};
+    put(&w, SAVESTATE_MAGIC, 4);
+    put_le(&w, SAVESTATE_VERSION, 2);
+    put_le(&w, sections, 1);
+    put_le(&w, full, 1);
+    if (sections & SECTION_REGISTERS)
+        put(&w, regs, sizeof regs);
+    if (sections & SECTION_DISPLAY)
+    {
+        put_mask(&w, rows, l.rows);
+        for (uint32_t y = 0; y < l.rows; y++)
+        {
+            for (uint32_t p = 0; rows[y / 8] >> (y % 8) & 1 && p < l.planes; p++)
+            {
+                for (uint32_t x = 0; x < l.words; x++)
+                    put_le(&w, chip8->display[p][x][y], 8);
+            }
+        }
+    }
+    if (sections & SECTION_RAM)
+    {
+        put_mask(&w, pages, l.pages);
+        for (uint32_t p = 0; p < l.pages; p++)
+        {
+            if (pages[p / 8] >> (p % 8) & 1)
+                put(&w, &chip8->ram[p * RAM_PAGE], RAM_PAGE);
+        }
+    }
+
+    if (snap && w.size <= cap)
+    {
+        memcpy(snap->regs, regs, sizeof regs);
+        memcpy(snap->display, chip8->display, sizeof snap->display);
+        memcpy(snap->ram, chip8->ram, l.pages * RAM_PAGE);
+        snap->valid = true;
+    }
+    return w.size;
+}
+
+// Decode a state written by save_state into a snapshot, without touching any machine.
+// A delta is applied on top of the snapshot it was taken against, which must hold the
+// previous state of the chain; a complete state replaces whatever the snapshot held, with
+// zeros where it leaves rows or pages out. A state for another machine than extension is
+// refused. On failure the snapshot is unchanged
+bool apply_state(snapshot_t *snap, const uint8_t *buf, size_t size, extension_t extension)
+{
+    reader_t r = {.data = buf, .size = size};
+    char magic[4];
+    uint64_t version, sections, full;
+    if (!get(&r, magic, 4) || memcmp(magic, SAVESTATE_MAGIC, 4) ||
+        !get_le(&r, &version, 2) || !get_le(&r, &sections, 1) || !get_le(&r, &full, 1))
+    {
+        printf("Not a save state\n");
+        return false;
+    }
+    if (version != SAVESTATE_VERSION)
+    {
+        printf("Save state version %u, this build reads version %u\n", (unsigned)version, SAVESTATE_VERSION);
+        return false;
+    }
+
+    // Decode into a scratch snapshot first so a truncated or corrupt state changes nothing
+    snapshot_t next;
+    if (full)
+        memset(&next, 0, sizeof next);
+    else if (snap->valid)
+        next = *snap;
+    else
+    {
+        printf("Save state is a delta, and there is no previous state to apply it to\n");
+        return false;
+    }
+
+    bool ok = true;
+    if (sections & SECTION_REGISTERS)
+        ok = get(&r, next.regs, sizeof next.regs);
+    if (ok && next.regs[REG_EXTENSION] > EXT_XOCHIP)
+    {
+        printf("Save state is for an unknown machine\n");
+        return false;
+    }
+    if (ok && next.regs[REG_EXTENSION] != extension)
+    {
+        printf("Save state is for a %s machine, this one is %s (--extension)\n",
+               extension_names[next.regs[REG_EXTENSION]], extension_names[extension]);
+        return false;
+    }
+    if (!full && next.regs[REG_EXTENSION] != snap->regs[REG_EXTENSION])
+    {
+        printf("Save state delta is for another machine than the state before it\n");
+        return false;
+    }
+    const layout_t l = state_layout(next.regs[REG_EXTENSION]);
+    if (ok && sections & SECTION_DISPLAY)
+    {
+        uint8_t rows[HIRES_HEIGHT / 8];
+        ok = get_mask(&r, rows, l.rows);
+        for (uint32_t y = 0; ok && y < l.rows; y++)
+        {
+            for (uint32_t p = 0; ok && rows[y / 8] >> (y % 8) & 1 && p < l.planes; p++)
+            {
+                for (uint32_t x = 0; ok && x < l.words; x++)
+                    ok = get_le(&r, &next.display[p][x][y], 8);
+            }
+        }
+    }
+    if (ok && sections & SECTION_RAM)
+    {
+        uint8_t pages[XO_RAM_SIZE / RAM_PAGE / 8];
+        ok = get_mask(&r, pages, l.pages);
+        for (uint32_t p = 0; ok && p < l.pages; p++)
+        {
+            if (pages[p / 8] >> (p % 8) & 1)
+                ok = get(&r, &next.ram[p * RAM_PAGE], RAM_PAGE);
+        }
+    }
+    if (!ok || r.pos != size || (full && !(sections & SECTION_REGISTERS)))
+    {
+        printf("Save state is truncated or corrupt\n");
+        return false;
+    }
+    if (!registers_valid(next.regs))
+    {
+        printf("Save state has invalid registers\n");
+        return false;
+    }
+
+    *snap = next;
+    snap->valid = true;
+    return true;
+}
+
+// Put the machine in the state held by a snapshot of the same kind of machine
+void restore_snapshot(chip8_t *chip8, const snapshot_t *snap)
+{
+    const bool hires = chip8->hires;
+    const size_t ram_size = EXT_RAM_SIZE(chip8->extension);
+    unpack_registers(chip8, snap->regs);
+    memcpy(chip8->display, snap->display, sizeof chip8->display);
+    chip8->dirty_rows = DISPLAY_ALL_ROWS;
+    if (memcmp(chip8->ram, snap->ram, ram_size))
+    {
+        memcpy(chip8->ram, snap->ram, ram_size);
+        invalidate_code(chip8); // Anything predecoded may now be stale
+    }
+    else if (chip8->hires != hires)
+        invalidate_code(chip8); // Display handlers are decoded for the mode
+}
+
+// Restore a state written by save_state. Deltas need the snapshot that loaded (or saved) the
+// previous state of the chain, a complete state needs none. The snapshot, when given, moves
+// to the loaded state
+bool load_state(chip8_t *chip8, snapshot_t *snap, const uint8_t *buf, size_t size)
+{
+    snapshot_t scratch = {.valid = false};
+    if (!snap)
+        snap = &scratch;
+    if (!apply_state(snap, buf, size, chip8->extension))
+        return false;
+    restore_snapshot(chip8, snap);
+    return true;
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Instruction traces: while a machine has a trace attached, every instruction appends one
+// 8 byte record (PC, opcode, and I, VX and VF after it ran) to a ring allocated up front, so
+// tracing costs a store per instruction instead of a printf, and the ring always holds the
+// last instructions before whatever went wrong. Dumps are read back by chip8-trace
+// (tracedump.c). Dump layout, integers little endian:
+//   header  "C8TR", u16 version, u32 records, u64 instructions traced in total
+//   records oldest first: u16 pc, u16 opcode, u16 I, u8 VX, u8 VF
+
+#define TRACE_MAGIC "C8TR"
+
+// Entries is rounded up to a power of two
+bool init_trace(trace_t *trace, uint32_t entries)
+{
+    memset(trace, 0, sizeof *trace);
+    uint32_t size = 1;
+    while (size < entries && size < (1u << 31))
+        size <<= 1;
+
+    trace->entries = calloc(size, sizeof *trace->entries);
+    if (!trace->entries)
+    {
+        printf("Could not allocate a trace of %u instructions\n", size);
+        return false;
+    }
+    trace->mask = size - 1;
+    return true;
+}
+
+void release_trace(trace_t *trace)
+{
+    free(trace->entries);
+    memset(trace, 0, sizeof *trace);
+}
+
+static void put_le(FILE *file, uint64_t value, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+// Write the instructions the ring holds, oldest first
+bool dump_trace(const trace_t *trace, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Could not create trace %s\n", path);
+        return false;
+    }
+
+    const uint64_t size = (uint64_t)trace->mask + 1;
+    const uint64_t records = trace->steps < size ? trace->steps : size;
+    fwrite(TRACE_MAGIC, 4, 1, file);
+    put_le(file, TRACE_VERSION, 2);
+    put_le(file, records, 4);
+    put_le(file, trace->steps, 8);
+    for (uint64_t step = trace->steps - records; step < trace->steps; step++)
+    {
+        const trace_entry_t *e = &trace->entries[step & trace->mask];
+        put_le(file, e->pc, 2);
+        put_le(file, e->opcode, 2);
+        put_le(file, e->I, 2);
+        put_le(file, e->vx, 1);
+        put_le(file, e->vf, 1);
+    }
+
+    const bool ok = !ferror(file);
+    if (fclose(file) || !ok)
+    {
+        printf("Could not write trace %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Assembly for an opcode, in the usual CHIP8 mnemonics and their SCHIP and XO-CHIP additions
+void disassemble(uint16_t opcode, char *buf, size_t size)
+{
+    const unsigned X = (opcode >> 8) & 0xF;
+    const unsigned Y = (opcode >> 4) & 0xF;
+    const unsigned N = opcode & 0xF;
+    const unsigned NN = opcode & 0xFF;
+    const unsigned NNN = opcode & 0xFFF;
+
+    switch (opcode >> 12)
+    {
+    case 0x0:
+        if (opcode == 0x00E0)
+            snprintf(buf, size, "CLS");
+        else if (opcode == 0x00EE)
+            snprintf(buf, size, "RET");
+        else if ((opcode & 0xFFF0) == 0x00C0)
+            snprintf(buf, size, "SCD %u", N);
+        else if ((opcode & 0xFFF0) == 0x00D0)
+            snprintf(buf, size, "SCU %u", N);
+        else if (opcode == 0x00FB)
+            snprintf(buf, size, "SCR");
+        else if (opcode == 0x00FC)
+            snprintf(buf, size, "SCL");
+        else if (opcode == 0x00FD)
+            snprintf(buf, size, "EXIT");
+        else if (opcode == 0x00FE)
+            snprintf(buf, size, "LOW");
+        else if (opcode == 0x00FF)
+            snprintf(buf, size, "HIGH");
+        else
+            snprintf(buf, size, "SYS 0x%03X", NNN);
+        return;
+    case 0x1: snprintf(buf, size, "JP 0x%03X", NNN); return;
+    case 0x2: snprintf(buf, size, "CALL 0x%03X", NNN); return;
+    case 0x3: snprintf(buf, size, "SE V%X, 0x%02X", X, NN); return;
+    case 0x4: snprintf(buf, size, "SNE V%X, 0x%02X", X, NN); return;
+    case 0x5:
+        if (N == 0)
+        {
+            snprintf(buf, size, "SE V%X, V%X", X, Y);
+            return;
+        }
+        if (N == 2 || N == 3)
+        {
+            snprintf(buf, size, N == 2 ? "LD [I], V%X-V%X" : "LD V%X-V%X, [I]", X, Y);
+            return;
+        }
+        break;
+    case 0x6: snprintf(buf, size, "LD V%X, 0x%02X", X, NN); return;
+    case 0x7: snprintf(buf, size, "ADD V%X, 0x%02X", X, NN); return;
+    case 0x8:
+    {
+        static const char *const alu[16] = {
+            [0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR", [0x4] = "ADD",
+            [0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN", [0xE] = "SHL",
+        };
+        if (alu[N])
+        {
+            snprintf(buf, size, "%s V%X, V%X", alu[N], X, Y);
+            return;
+        }
+        break;
+    }
+    case 0x9:
+        if (N == 0)
+        {
+            snprintf(buf, size, "SNE V%X, V%X", X, Y);
+            return;
+        }
+        break;
+    case 0xA: snprintf(buf, size, "LD I, 0x%03X", NNN); return;
+    case 0xB: snprintf(buf, size, "JP V0, 0x%03X", NNN); return;
+    case 0xC: snprintf(buf, size, "RND V%X, 0x%02X", X, NN); return;
+    case 0xD: snprintf(buf, size, "DRW V%X, V%X, %u", X, Y, N); return;
+    case 0xE:
+        if (NN == 0x9E)
+        {
+            snprintf(buf, size, "SKP V%X", X);
+            return;
+        }
+        if (NN == 0xA1)
+        {
+            snprintf(buf, size, "SKNP V%X", X);
+            return;
+        }
+        break;
+    case 0xF:
+        if (opcode == 0xF000)
+        {
+            snprintf(buf, size, "LD I, long");
+            return;
+        }
+        switch (NN)
+        {
+        case 0x01: snprintf(buf, size, "PLANE %u", X); return;
+        case 0x02:
+            if (X == 0)
+            {
+                snprintf(buf, size, "AUDIO");
+                return;
+            }
+            break;
+        case 0x07: snprintf(buf, size, "LD V%X, DT", X); return;
+        case 0x0A: snprintf(buf, size, "LD V%X, K", X); return;
+        case 0x15: snprintf(buf, size, "LD DT, V%X", X); return;
+        case 0x18: snprintf(buf, size, "LD ST, V%X", X); return;
+        case 0x1E: snprintf(buf, size, "ADD I, V%X", X); return;
+        case 0x29: snprintf(buf, size, "LD F, V%X", X); return;
+        case 0x33: snprintf(buf, size, "LD B, V%X", X); return;
+        case 0x55: snprintf(buf, size, "LD [I], V%X", X); return;
+        case 0x65: snprintf(buf, size, "LD V%X, [I]", X); return;
+        case 0x30: snprintf(buf, size, "LD HF, V%X", X); return;
+        case 0x75: snprintf(buf, size, "LD R, V%X", X); return;
+        case 0x85: snprintf(buf, size, "LD V%X, R", X); return;
+        case 0x3A: snprintf(buf, size, "PITCH V%X", X); return;
+        default: break;
+        }
+        break;
+    }
+    snprintf(buf, size, "DW 0x%04X", opcode); // Not an instruction on any machine, executes as a no-op
+}
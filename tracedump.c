@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// chip8-trace: prints a trace dumped by --trace (see trace.c) as disassembly, one line per
+// instruction, oldest first, with the registers the instruction writes as it left them.
+// --last N prints only the newest N instructions.
+
+static bool get_le(FILE *file, uint64_t *value, size_t n)
+{
+    *value = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        *value |= (uint64_t)byte << (8 * i);
+    }
+    return true;
+}
+
+static bool read_entry(FILE *file, trace_entry_t *e)
+{
+    uint64_t pc, opcode, I, vx, vf;
+    if (!get_le(file, &pc, 2) || !get_le(file, &opcode, 2) || !get_le(file, &I, 2) ||
+        !get_le(file, &vx, 1) || !get_le(file, &vf, 1))
+        return false;
+    *e = (trace_entry_t){.pc = pc, .opcode = opcode, .I = I, .vx = vx, .vf = vf};
+    return true;
+}
+
+// The registers an instruction writes, from its opcode, as they were after it
+static void format_writes(const trace_entry_t *e, char *buf, size_t size)
+{
+    const uint16_t op = e->opcode;
+    const unsigned X = (op >> 8) & 0xF;
+    const unsigned NN = op & 0xFF;
+    bool vx = false, vf = false, I = false;
+
+    switch (op >> 12)
+    {
+    case 0x6: case 0x7: case 0xC: vx = true; break;
+    case 0x8:
+        vx = (op & 0xF) <= 0x7 || (op & 0xF) == 0xE;
+        vf = vx && (op & 0xF) != 0; // Flags, or the VF reset quirk on 8XY1-8XY3
+        break;
+    case 0x5: vx = (op & 0xF) == 0x3; break; // 5XY3: VX up to VY, VX shown
+    case 0xA: I = true; break;
+    case 0xD: vf = true; break;
+    case 0xF:
+        vx = NN == 0x07 || NN == 0x0A || NN == 0x65 || NN == 0x85; // FX65, FX85: V0 up to VX, VX shown
+        I = NN == 0x1E || NN == 0x29 || NN == 0x30 || NN == 0x55 || NN == 0x65 || op == 0xF000;
+        break;
+    default: break;
+    }
+
+    int n = 0;
+    buf[0] = '\0';
+    if (vx)
+        n += snprintf(buf + n, size - n, " V%X=%02X", X, e->vx);
+    if (vf && X != 0xF)
+        n += snprintf(buf + n, size - n, " VF=%02X", e->vf);
+    if (I)
+        snprintf(buf + n, size - n, " I=%03X", e->I);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    uint64_t last = UINT64_MAX;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--last") && i + 1 < argc)
+            last = strtoull(argv[++i], NULL, 0);
+        else
+            path = argv[i];
+    }
+    if (!path)
+    {
+        printf("Usage: %s <trace_file> [--last N]\n", argv[0]);
+        return -1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("Could not open trace %s\n", path);
+        return -1;
+    }
+    char magic[4];
+    uint64_t version, records, steps;
+    if (fread(magic, 4, 1, file) != 1 || memcmp(magic, "C8TR", 4) || !get_le(file, &version, 2) ||
+        !get_le(file, &records, 4) || !get_le(file, &steps, 8))
+    {
+        printf("%s is not a trace\n", path);
+        fclose(file);
+        return -1;
+    }
+    if (version != TRACE_VERSION)
+    {
+        printf("Trace version %u, this build reads version %u\n", (unsigned)version, TRACE_VERSION);
+        fclose(file);
+        return -1;
+    }
+
+    // Instructions traced before the ring wrapped are gone, number from where it starts
+    const uint64_t skip = last < records ? records - last : 0;
+    printf("%llu instructions traced, the last %llu kept\n", (unsigned long long)steps, (unsigned long long)records);
+    if (fseek(file, skip * 8, SEEK_CUR))
+    {
+        printf("Trace is truncated\n");
+        fclose(file);
+        return -1;
+    }
+
+    for (uint64_t i = skip; i < records; i++)
+    {
+        trace_entry_t e;
+        if (!read_entry(file, &e))
+        {
+            printf("Trace is truncated after %llu records\n", (unsigned long long)i);
+            fclose(file);
+            return -1;
+        }
+        char text[32], writes[32];
+        disassemble(e.opcode, text, sizeof text);
+        format_writes(&e, writes, sizeof writes);
+        printf("%10llu  %03X  %04X  %-*s%s\n", (unsigned long long)(steps - records + i), e.pc, e.opcode,
+               writes[0] ? 16 : 0, text, writes);
+    }
+    fclose(file);
+    return 0;
+}